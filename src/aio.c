@@ -2,6 +2,7 @@
 
 #define NANONEXT_SIGNALS
 #include "nanonext.h"
+#include <stdatomic.h>
 
 // internals -------------------------------------------------------------------
 
@@ -17,23 +18,140 @@ static SEXP mk_error_aio(const int xc, SEXP env) {
 
 }
 
+// aio pools -------------------------------------------------------------------
+
+// Idle aios are kept for reuse, one pool per completion callback, as an
+// nng_aio remains bound to the callback it was allocated with. The pools are
+// only accessed from the R thread (allocation sites and finalizers).
+
+static nano_aio *aio_pool[NANO_POOLS];
+static int aio_pool_n[NANO_POOLS];
+static double aio_pool_hits[NANO_POOLS];
+static double aio_pool_misses[NANO_POOLS];
+
+static void nano_pool_free(nano_aio *p) {
+
+  if (p->pool == NANO_POOL_REQ) {
+    nano_saio *saio = (nano_saio *) p->cb;
+    nng_aio_free(saio->aio);
+    free(saio);
+  }
+  nng_aio_free(p->aio);
+  if (p->data != NULL)
+    nng_msg_free((nng_msg *) p->data);
+  free(p);
+
+}
+
+// returns a reset aio of the requested type, or NULL if the pool is empty
+nano_aio *nano_pool_get(const nano_pool_typ type) {
+
+  nano_aio *p = aio_pool[type];
+  if (p == NULL) {
+    aio_pool_misses[type]++;
+    return NULL;
+  }
+  aio_pool[type] = (nano_aio *) p->next;
+  aio_pool_n[type]--;
+  aio_pool_hits[type]++;
+
+  nng_aio *aio = p->aio;
+  void *cb = p->cb;
+  memset(p, 0, sizeof(nano_aio));
+  p->aio = aio;
+  p->pool = (uint8_t) type;
+  if (type == NANO_POOL_REQ) {
+    nano_saio *saio = (nano_saio *) cb;
+    aio = saio->aio;
+    memset(saio, 0, sizeof(nano_saio));
+    saio->aio = aio;
+    p->cb = saio;
+  }
+
+  return p;
+
+}
+
+// stops and resets an aio no longer referenced from R, returning it to its
+// pool, or frees it if the pool is already full - a stopped aio can only be
+// reset for reuse by the bundled 'libnng', so is always freed otherwise
+void nano_pool_put(nano_aio *p) {
+
+#ifdef NANONEXT_BUNDLED
+  const nano_pool_typ type = (nano_pool_typ) p->pool;
+  if (aio_pool_n[type] >= NANO_POOL_MAX) {
+    nano_pool_free(p);
+    return;
+  }
+
+  nng_aio_reset(p->aio);
+  if (type == NANO_POOL_REQ)
+    nng_aio_reset(((nano_saio *) p->cb)->aio);
+  if (p->data != NULL) {
+    nng_msg_free((nng_msg *) p->data);
+    p->data = NULL;
+  }
+  p->next = aio_pool[type];
+  aio_pool[type] = p;
+  aio_pool_n[type]++;
+#else
+  nano_pool_free(p);
+#endif
+
+}
+
+static void nano_pool_drain(void) {
+
+  for (int i = NANO_POOL_SEND; i < NANO_POOLS; i++) {
+    while (aio_pool[i] != NULL) {
+      nano_aio *p = aio_pool[i];
+      aio_pool[i] = (nano_aio *) p->next;
+      nano_pool_free(p);
+    }
+    aio_pool_n[i] = 0;
+  }
+
+}
+
 // aio completion callbacks ----------------------------------------------------
 
+static _Atomic(nng_mtx *) free_mtx_ptr = NULL;
+
+// the free list mutex is allocated on first use rather than at package load,
+// as this initializes NNG, which must wait until init parameters are applied
+static nng_mtx *nano_free_mtx(void) {
+
+  nng_mtx *mtx = atomic_load_explicit(&free_mtx_ptr, memory_order_acquire);
+  if (mtx != NULL)
+    return mtx;
+
+  nng_mtx *cur = NULL;
+  if (nng_mtx_alloc(&mtx))
+    return NULL;
+  if (!atomic_compare_exchange_strong_explicit(&free_mtx_ptr, &cur, mtx, memory_order_acq_rel, memory_order_acquire)) {
+    nng_mtx_free(mtx);
+    mtx = cur;
+  }
+  return mtx;
+
+}
+
 void nano_list_do(nano_list_op listop, nano_aio *saio) {
 
   static nano_aio *free_list = NULL;
-  static nng_mtx *free_mtx = NULL;
+  nng_mtx *free_mtx;
 
   switch (listop) {
-  case INIT:
-    if (free_mtx == NULL && nng_mtx_alloc(&free_mtx))
-      Rf_error("NNG library init failure");
-    break;
   case FINALIZE:
+    free_mtx = nano_free_mtx();
     nng_mtx_lock(free_mtx);
     nano_list_do(FREE, NULL);
     if (saio->mode == 0x1) {
       nng_mtx_unlock(free_mtx);
+      if (saio->pool) {
+        nano_pool_put(saio);
+        break;
+      }
       nng_aio_free(saio->aio);
       if (saio->data != NULL)
         free(saio->data);
@@ -44,6 +162,7 @@ void nano_list_do(nano_list_op listop, nano_aio *saio) {
     }
     break;
   case COMPLETE:
+    free_mtx = nano_free_mtx();
     nng_mtx_lock(free_mtx);
     if (saio->mode == 0x1) {
       saio->next = free_list;
@@ -54,17 +173,22 @@ void nano_list_do(nano_list_op listop, nano_aio *saio) {
     nng_mtx_unlock(free_mtx);
     break;
   case SHUTDOWN:
+    free_mtx = atomic_exchange_explicit(&free_mtx_ptr, NULL, memory_order_acq_rel);
     if (free_mtx == NULL) break;
     nng_mtx_lock(free_mtx);
     nano_list_do(FREE, NULL);
     nng_mtx_unlock(free_mtx);
     nng_mtx_free(free_mtx);
-    free_mtx = NULL;
+    nano_pool_drain();
     break;
   case FREE: // must be entered under lock
     while (free_list != NULL) {
       nano_aio *current = free_list;
       free_list = (nano_aio *) current->next;
+      if (current->pool) {
+        nano_pool_put(current);
+        continue;
+      }
       nng_aio_free(current->aio);
       if (current->data != NULL)
         free(current->data);
@@ -84,6 +208,7 @@ static void saio_complete(void *arg) {
   saio->result = res - !res;
 
   nano_list_do(COMPLETE, saio);
+  nano_wait_notify();
 
 }
 
@@ -91,9 +216,59 @@ static void isaio_complete(void *arg) {
 
   nano_aio *iaio = (nano_aio *) arg;
   const int res = nng_aio_result(iaio->aio);
+  // an arena is returned at once on error, as there is nothing to decode
+  if (res && iaio->arena != NULL) {
+    nano_arena_give(iaio->arena, 0);
+    iaio->arena = NULL;
+    iaio->data = NULL;
+  }
   iaio->result = res - !res;
 
   nano_list_do(COMPLETE, iaio);
+  nano_wait_notify();
+
+}
+
+// sends the next queued message of a batch, or marks the batch complete
+static void batch_next(nano_aio *saio) {
+
+  nano_batch *b = (nano_batch *) saio->data;
+  while (b->cur < b->n && b->msgs[b->cur] == NULL)
+    b->cur++;
+
+  if (b->cur == b->n) {
+    saio->result = -1;
+    nano_list_do(COMPLETE, saio);
+    nano_wait_notify();
+    return;
+  }
+
+  nng_aio_set_msg(saio->aio, b->msgs[b->cur]);
+  b->sock ? nng_send_aio(b->con.sock, saio->aio) : nng_ctx_send(b->con.ctx, saio->aio);
+
+}
+
+static void batch_complete(void *arg) {
+
+  nano_aio *saio = (nano_aio *) arg;
+  nano_batch *b = (nano_batch *) saio->data;
+  const int res = nng_aio_result(saio->aio);
+  if (res)
+    nng_msg_free(nng_aio_get_msg(saio->aio));
+  b->msgs[b->cur] = NULL;
+  b->status[b->cur++] = res;
+
+  if (res == NNG_ECANCELED || res == NNG_ECLOSED) {
+    for (; b->cur < b->n; b->cur++) {
+      if (b->msgs[b->cur] == NULL) continue;
+      nng_msg_free(b->msgs[b->cur]);
+      b->msgs[b->cur] = NULL;
+      b->status[b->cur] = res;
+    }
+  }
+
+  batch_next(saio);
+  nano_wait_notify();
 
 }
 
@@ -116,17 +291,92 @@ static void raio_complete(void *arg) {
     nng_mtx_lock(mtx);
     raio->result = res;
     ncv->condition++;
+    if (ncv->cq != NULL)
+      nano_cq_push(ncv->cq, &raio->qid);
+    nng_cv_wake(cv);
+    nng_mtx_unlock(mtx);
+  } else {
+    raio->result = res;
+  }
+
+  nano_wait_notify();
+
+  if (raio->cb != NULL)
+    later2(raio_invoke_cb, raio->cb);
+
+}
+
+// returns the framer to its Stream and resolves the Aio with a frame or error
+static void fraio_finish(nano_aio *raio, nng_msg *msg, int res) {
+
+  nano_framer *f = (nano_framer *) raio->data;
+  nng_mtx_lock(f->mtx);
+  f->busy = 0;
+  nng_mtx_unlock(f->mtx);
+  nano_framer_release(f);
+
+  raio->data = msg;
+  res = res ? res : -1;
+
+  if (raio->next != NULL) {
+    nano_cv *ncv = (nano_cv *) raio->next;
+    nng_cv *cv = ncv->cv;
+    nng_mtx *mtx = ncv->mtx;
+
+    nng_mtx_lock(mtx);
+    raio->result = res;
+    ncv->condition++;
+    if (ncv->cq != NULL)
+      nano_cq_push(ncv->cq, &raio->qid);
     nng_cv_wake(cv);
     nng_mtx_unlock(mtx);
   } else {
     raio->result = res;
   }
 
+  nano_wait_notify();
+
   if (raio->cb != NULL)
     later2(raio_invoke_cb, raio->cb);
 
 }
 
+// reads into the framer of a Stream until a complete frame is buffered
+static void fraio_complete(void *arg) {
+
+  nano_aio *raio = (nano_aio *) arg;
+  nano_framer *f = (nano_framer *) raio->data;
+  nng_msg *msg = NULL;
+  int res = nng_aio_result(raio->aio);
+
+  nng_mtx_lock(f->mtx);
+  if (res == 0) {
+    f->len += nng_aio_count(raio->aio);
+    if ((res = nano_frame_take(f, &msg)) < 0) {
+      if (f->closed) {
+        res = NNG_ECLOSED;
+      } else if ((res = nano_frame_prep(f, raio->aio)) == 0) {
+        nng_stream_recv(f->stream, raio->aio);
+        nng_mtx_unlock(f->mtx);
+        return;
+      }
+    }
+  }
+  nng_mtx_unlock(f->mtx);
+
+  fraio_finish(raio, msg, res);
+
+}
+
+// a stop landing whilst fraio_complete() re-posts its read has the read
+// rejected without a callback, so the Aio is resolved here instead
+static void fraio_stopped(nano_aio *raio) {
+
+  if (raio->framed && raio->result == 0)
+    fraio_finish(raio, NULL, NNG_ECANCELED);
+
+}
+
 static void raio_complete_interrupt(void *arg) {
 
   nano_aio *raio = (nano_aio *) arg;
@@ -140,6 +390,8 @@ static void raio_complete_interrupt(void *arg) {
 
   raio->result = res;
 
+  nano_wait_notify();
+
   if (raio->cb != NULL)
     later2(raio_invoke_cb, raio->cb);
 
@@ -167,34 +419,429 @@ static void iraio_complete(void *arg) {
     nng_mtx_lock(mtx);
     iaio->result = res - !res;
     ncv->condition++;
+    if (ncv->cq != NULL)
+      nano_cq_push(ncv->cq, &iaio->qid);
     nng_cv_wake(cv);
     nng_mtx_unlock(mtx);
   } else {
     iaio->result = res - !res;
   }
 
+  nano_wait_notify();
+
   if (iaio->cb != NULL)
     later2(raio_invoke_cb, iaio->cb);
 
 }
 
+static int pipeline_stopped(nano_pipeline *p) {
+
+  nng_mtx_lock(p->mtx);
+  const int stopped = p->stopped;
+  nng_mtx_unlock(p->mtx);
+  return stopped;
+
+}
+
+// posts the next receive unless the pipeline has been stopped - a stop landing
+// after the check may have cancelled ahead of the post, so is checked again
+static void pipeline_next(nano_pipeline *p) {
+
+  if (pipeline_stopped(p))
+    return;
+  nng_recv_aio(p->from, p->raio);
+  if (pipeline_stopped(p))
+    nng_aio_cancel(p->raio);
+
+}
+
+// applies each stage in turn, returning 0 if the message is to be dropped
+static int pipeline_apply(const nano_pipeline *p, nng_msg *msg) {
+
+  for (int i = 0; i < p->nstages; i++) {
+    const nano_stage *st = &p->stages[i];
+    const size_t len = nng_msg_len(msg);
+    switch (st->op) {
+    case STAGE_PREFIX:
+      if (len < st->len || memcmp(nng_msg_body(msg), st->buf, st->len))
+        return 0;
+      break;
+    case STAGE_STRIP:
+      if (len < st->len || nng_msg_trim(msg, st->len))
+        return 0;
+      break;
+    case STAGE_PREPEND:
+      if (nng_msg_insert(msg, st->buf, st->len))
+        return 0;
+      break;
+    case STAGE_MIN:
+      if (len < st->len)
+        return 0;
+      break;
+    case STAGE_MAX:
+      if (len > st->len)
+        return 0;
+      break;
+    }
+  }
+  return 1;
+
+}
+
+// completes a sentinel aio, which is held pending for the life of a
+// pipeline or broker
+static void sentinel_cancel(nng_aio *aio, void *arg, int rv) {
+
+  nng_aio_finish(aio, rv);
+
+}
+
+static void pipeline_recv_complete(void *arg) {
+
+  nano_pipeline *p = (nano_pipeline *) arg;
+  const int res = nng_aio_result(p->raio);
+  if (res == NNG_ETIMEDOUT) {
+    pipeline_next(p);
+    return;
+  }
+  if (res) {
+    nng_aio_abort(p->sentinel, res);
+    return;
+  }
+
+  nng_msg *msg = nng_aio_get_msg(p->raio);
+  const int pass = pipeline_apply(p, msg);
+  nng_mtx_lock(p->mtx);
+  p->stats[0]++;
+  p->stats[1] += !pass;
+  nng_mtx_unlock(p->mtx);
+  if (!pass) {
+    nng_msg_free(msg);
+    pipeline_next(p);
+    return;
+  }
+
+  // the last target takes the original message, the others a copy each
+  int k = 0;
+  for (int i = 0; i < p->n; i++) {
+    if (i == p->n - 1) {
+      p->out[i] = msg;
+    } else if (nng_msg_dup(&p->out[i], msg)) {
+      p->out[i] = NULL;
+    }
+    k += p->out[i] != NULL;
+  }
+
+  nng_mtx_lock(p->mtx);
+  const int stopped = p->stopped;
+  p->pending = stopped ? 0 : k;
+  p->stats[3] += p->n - k;
+  nng_mtx_unlock(p->mtx);
+
+  for (int i = 0; i < p->n; i++) {
+    if (p->out[i] == NULL) continue;
+    if (stopped) {
+      nng_msg_free(p->out[i]);
+      continue;
+    }
+    nng_aio_set_msg(p->targets[i].aio, p->out[i]);
+    nng_send_aio(p->targets[i].sock, p->targets[i].aio);
+  }
+  if (!stopped && pipeline_stopped(p)) {
+    for (int i = 0; i < p->n; i++)
+      nng_aio_cancel(p->targets[i].aio);
+  }
+  nano_wait_notify();
+
+}
+
+static void pipeline_send_complete(void *arg) {
+
+  nano_ptarget *t = (nano_ptarget *) arg;
+  nano_pipeline *p = t->p;
+  const int res = nng_aio_result(t->aio);
+  if (res)
+    nng_msg_free(nng_aio_get_msg(t->aio));
+  if (res == NNG_ECLOSED)
+    nng_aio_abort(p->sentinel, res);
+
+  nng_mtx_lock(p->mtx);
+  p->stats[res ? 3 : 2]++;
+  const int next = --p->pending == 0;
+  nng_mtx_unlock(p->mtx);
+
+  if (next)
+    pipeline_next(p);
+  nano_wait_notify();
+
+}
+
+static void pipeline_complete(void *arg) {
+
+  nano_aio *saio = (nano_aio *) arg;
+  nano_pipeline *p = (nano_pipeline *) saio->data;
+  const int res = nng_aio_result(saio->aio);
+
+  nng_mtx_lock(p->mtx);
+  p->stopped = 1;
+  nng_mtx_unlock(p->mtx);
+  nng_aio_cancel(p->raio);
+  for (int i = 0; i < p->n; i++)
+    nng_aio_cancel(p->targets[i].aio);
+
+  saio->result = res - !res;
+  nano_wait_notify();
+
+}
+
+static int broker_stopped(nano_broker *b) {
+
+  nng_mtx_lock(b->mtx);
+  const int stopped = b->stopped;
+  nng_mtx_unlock(b->mtx);
+  return stopped;
+
+}
+
+// posts a receive unless the broker has been stopped - a stop landing after
+// the check may have cancelled ahead of the post, so is checked again
+static void broker_recv(nano_broker *b, nng_socket sock, nng_aio *aio) {
+
+  if (broker_stopped(b))
+    return;
+  nng_recv_aio(sock, aio);
+  if (broker_stopped(b))
+    nng_aio_cancel(aio);
+
+}
+
+// sends a message already checked against a stop, checking again after posting
+static void broker_send(nano_broker *b, nng_socket sock, nng_aio *aio, nng_msg *msg) {
+
+  nng_aio_set_msg(aio, msg);
+  nng_send_aio(sock, aio);
+  if (broker_stopped(b))
+    nng_aio_cancel(aio);
+
+}
+
+static void broker_front_complete(void *arg) {
+
+  nano_bside *f = (nano_bside *) arg;
+  nano_broker *b = f->b;
+  const int res = nng_aio_result(f->recv);
+  if (res == NNG_ETIMEDOUT) {
+    broker_recv(b, f->sock, f->recv);
+    return;
+  }
+  if (res) {
+    nng_aio_abort(b->sentinel, res);
+    return;
+  }
+
+  nng_msg *msg = nng_aio_get_msg(f->recv);
+  const size_t len = nng_msg_len(msg);
+
+  nng_mtx_lock(b->mtx);
+  if (b->stopped) {
+    nng_mtx_unlock(b->mtx);
+    nng_msg_free(msg);
+    return;
+  }
+  f->stats[0]++;
+  f->stats[1] += len;
+  int i = b->next;
+  if (b->least) {
+    // fewest outstanding, ties broken in round-robin order
+    for (int j = 0, k = b->next; j < b->n; j++, k = k % b->n + 1) {
+      if (b->sides[k].depth < b->sides[i].depth)
+        i = k;
+    }
+  }
+  b->next = i % b->n + 1;
+  nano_bside *t = &b->sides[i];
+  t->depth++;
+  t->len = len;
+  nng_mtx_unlock(b->mtx);
+
+  broker_send(b, t->sock, t->send, msg);
+  nano_wait_notify();
+
+}
+
+static void broker_send_complete(void *arg) {
+
+  nano_bside *t = (nano_bside *) arg;
+  nano_broker *b = t->b;
+  const int res = nng_aio_result(t->send);
+  if (res)
+    nng_msg_free(nng_aio_get_msg(t->send));
+  if (res == NNG_ECLOSED)
+    nng_aio_abort(b->sentinel, res);
+
+  // a failed send is dropped: no reply will arrive, so the backend's depth is
+  // released, and the frontend receives the next message in either case
+  nng_mtx_lock(b->mtx);
+  if (res) {
+    if (t->depth > 0)
+      t->depth--;
+  } else {
+    t->stats[2]++;
+    t->stats[3] += t->len;
+  }
+  nng_mtx_unlock(b->mtx);
+
+  if (res != NNG_ECLOSED)
+    broker_recv(b, b->sides[0].sock, b->sides[0].recv);
+  nano_wait_notify();
+
+}
+
+static void broker_recv_complete(void *arg) {
+
+  nano_bside *t = (nano_bside *) arg;
+  nano_broker *b = t->b;
+  nano_bside *f = &b->sides[0];
+  const int res = nng_aio_result(t->recv);
+  // a receive timeout set on the Socket leaves the backend waiting for replies
+  if (res == NNG_ETIMEDOUT) {
+    broker_recv(b, t->sock, t->recv);
+    return;
+  }
+  if (res) {
+    nng_aio_abort(b->sentinel, res);
+    return;
+  }
+
+  nng_msg *msg = nng_aio_get_msg(t->recv);
+  const size_t len = nng_msg_len(msg);
+
+  nng_mtx_lock(b->mtx);
+  if (b->stopped) {
+    nng_mtx_unlock(b->mtx);
+    nng_msg_free(msg);
+    return;
+  }
+  t->stats[0]++;
+  t->stats[1] += len;
+  if (t->depth > 0)
+    t->depth--;
+  t->rlen = len;
+  f->depth++;
+  nng_mtx_unlock(b->mtx);
+
+  broker_send(b, f->sock, t->reply, msg);
+  nano_wait_notify();
+
+}
+
+static void broker_reply_complete(void *arg) {
+
+  nano_bside *t = (nano_bside *) arg;
+  nano_broker *b = t->b;
+  nano_bside *f = &b->sides[0];
+  const int res = nng_aio_result(t->reply);
+  if (res)
+    nng_msg_free(nng_aio_get_msg(t->reply));
+  if (res == NNG_ECLOSED)
+    nng_aio_abort(b->sentinel, res);
+
+  nng_mtx_lock(b->mtx);
+  f->depth--;
+  if (!res) {
+    f->stats[2]++;
+    f->stats[3] += t->rlen;
+  }
+  nng_mtx_unlock(b->mtx);
+
+  if (res != NNG_ECLOSED)
+    broker_recv(b, t->sock, t->recv);
+  nano_wait_notify();
+
+}
+
+static void broker_complete(void *arg) {
+
+  nano_aio *saio = (nano_aio *) arg;
+  nano_broker *b = (nano_broker *) saio->data;
+  const int res = nng_aio_result(saio->aio);
+
+  nng_mtx_lock(b->mtx);
+  b->stopped = 1;
+  nng_mtx_unlock(b->mtx);
+  nng_aio_cancel(b->sides[0].recv);
+  for (int i = 1; i <= b->n; i++) {
+    nng_aio_cancel(b->sides[i].send);
+    nng_aio_cancel(b->sides[i].recv);
+    nng_aio_cancel(b->sides[i].reply);
+  }
+
+  saio->result = res - !res;
+  nano_wait_notify();
+
+}
+
 // finalisers ------------------------------------------------------------------
 
 static void saio_finalizer(SEXP xptr) {
 
   if (NANO_PTR(xptr) == NULL) return;
   nano_aio *xp = (nano_aio *) NANO_PTR(xptr);
+  nano_timer_detach(xptr, xp->aio);
   nano_list_do(FINALIZE, xp);
 
 }
 
+static void batch_finalizer(SEXP xptr) {
+
+  if (NANO_PTR(xptr) == NULL) return;
+  nano_aio *xp = (nano_aio *) NANO_PTR(xptr);
+  nano_timer_detach(xptr, xp->aio);
+  nano_batch *b = (nano_batch *) xp->data;
+  if (b->started) {
+    nano_list_do(FINALIZE, xp);
+    return;
+  }
+  // not submitted, as interrupted by an error whilst encoding messages
+  for (R_xlen_t i = 0; i < b->n; i++)
+    nng_msg_free(b->msgs[i]);
+  nng_aio_free(xp->aio);
+  free(b);
+  free(xp);
+
+}
+
 static void iaio_finalizer(SEXP xptr) {
 
   if (NANO_PTR(xptr) == NULL) return;
   nano_aio *xp = (nano_aio *) NANO_PTR(xptr);
+  nano_timer_detach(xptr, xp->aio);
   nng_aio_free(xp->aio);
-  if (xp->data != NULL)
+  if (xp->arena != NULL) {
+    nano_arena_give(xp->arena, 0);
+  } else if (xp->data != NULL) {
     free(xp->data);
+  }
+  free(xp);
+
+}
+
+static void fraio_finalizer(SEXP xptr) {
+
+  if (NANO_PTR(xptr) == NULL) return;
+  nano_aio *xp = (nano_aio *) NANO_PTR(xptr);
+  nano_timer_detach(xptr, xp->aio);
+  nng_aio_free(xp->aio);
+  // an Aio stopped whilst re-posting its read never completes
+  if (xp->result == 0) {
+    nano_framer *f = (nano_framer *) xp->data;
+    nng_mtx_lock(f->mtx);
+    f->busy = 0;
+    nng_mtx_unlock(f->mtx);
+    nano_framer_release(f);
+  } else if (xp->data != NULL) {
+    nng_msg_free((nng_msg *) xp->data);
+  }
   free(xp);
 
 }
@@ -203,6 +850,11 @@ static void raio_finalizer(SEXP xptr) {
 
   if (NANO_PTR(xptr) == NULL) return;
   nano_aio *xp = (nano_aio *) NANO_PTR(xptr);
+  nano_timer_detach(xptr, xp->aio);
+  if (xp->pool) {
+    nano_pool_put(xp);
+    return;
+  }
   nng_aio_free(xp->aio);
   if (xp->data != NULL)
     nng_msg_free((nng_msg *) xp->data);
@@ -210,10 +862,66 @@ static void raio_finalizer(SEXP xptr) {
 
 }
 
+static void pipeline_finalizer(SEXP xptr) {
+
+  if (NANO_PTR(xptr) == NULL) return;
+  nano_aio *xp = (nano_aio *) NANO_PTR(xptr);
+  nano_timer_detach(xptr, xp->aio);
+  nano_pipeline *p = (nano_pipeline *) xp->data;
+  nng_aio_stop(xp->aio);
+  nng_aio_stop(p->raio);
+  for (int i = 0; i < p->n; i++)
+    nng_aio_stop(p->targets[i].aio);
+  for (int i = 0; i < p->n; i++)
+    nng_aio_free(p->targets[i].aio);
+  nng_aio_free(p->raio);
+  nng_aio_free(xp->aio);
+  nng_mtx_free(p->mtx);
+  free(p->stages);
+  free(p);
+  free(xp);
+
+}
+
+static void broker_finalizer(SEXP xptr) {
+
+  if (NANO_PTR(xptr) == NULL) return;
+  nano_aio *xp = (nano_aio *) NANO_PTR(xptr);
+  nano_timer_detach(xptr, xp->aio);
+  nano_broker *b = (nano_broker *) xp->data;
+  nng_aio_stop(xp->aio);
+  nng_aio_stop(b->sides[0].recv);
+  for (int i = 1; i <= b->n; i++) {
+    nng_aio_stop(b->sides[i].recv);
+    nng_aio_stop(b->sides[i].send);
+    nng_aio_stop(b->sides[i].reply);
+  }
+  for (int i = 0; i <= b->n; i++) {
+    nng_aio_free(b->sides[i].send);
+    nng_aio_free(b->sides[i].recv);
+    nng_aio_free(b->sides[i].reply);
+  }
+  nng_aio_free(xp->aio);
+  nng_mtx_free(b->mtx);
+  free(b);
+  free(xp);
+
+}
+
 // core aio - internal ---------------------------------------------------------
 
 static inline SEXP create_aio_result(SEXP env, nano_aio *saio) {
 
+  if (saio->type == BATCH_SENDAIO) {
+    nano_batch *b = (nano_batch *) saio->data;
+    SEXP out = Rf_allocVector(INTSXP, b->n);
+    if (b->n)
+      memcpy(NANO_DATAPTR(out), b->status, b->n * sizeof(int));
+    Rf_defineVar(nano_ValueSymbol, out, env);
+    Rf_defineVar(nano_AioSymbol, R_NilValue, env);
+    return out;
+  }
+
   if (saio->result > 0)
     return mk_error_aio(saio->result, env);
 
@@ -223,26 +931,36 @@ static inline SEXP create_aio_result(SEXP env, nano_aio *saio) {
 
 }
 
-static inline SEXP create_aio_msg(SEXP env, SEXP aio, nano_aio *raio, int res) {
-
-  SEXP out, pipe;
-  unsigned char *buf;
-  size_t sz;
+static SEXP aio_decode(SEXP aio, nano_aio *raio) {
 
+  SEXP out;
   if (raio->type == IOV_RECVAIO || raio->type == IOV_RECVAIOS) {
-    buf = raio->data;
-    sz = nng_aio_count(raio->aio);
-    PROTECT(out = nano_decode(buf, sz, raio->mode, NANO_PROT(aio)));
-    free(raio->data);
+    const size_t sz = nng_aio_count(raio->aio);
+    if (raio->arena != NULL) {
+      // the arena passes to the cleanup, which returns it even on error
+      nano_adecode d = {raio->arena, raio->data, sz, raio->mode, NANO_PROT(aio)};
+      raio->arena = NULL;
+      raio->data = NULL;
+      out = R_UnwindProtect(nano_arena_decode, &d, nano_arena_cleanup, &d, NULL);
+    } else {
+      out = nano_decode(raio->data, sz, raio->mode, NANO_PROT(aio));
+      free(raio->data);
+    }
   } else {
     nng_msg *msg = (nng_msg *) raio->data;
-    buf = nng_msg_body(msg);
-    sz = nng_msg_len(msg);
-    PROTECT(out = nano_decode(buf, sz, raio->mode, NANO_PROT(aio)));
+    out = nano_decode(nng_msg_body(msg), nng_msg_len(msg), raio->mode, NANO_PROT(aio));
     nng_msg_free(msg);
   }
   raio->data = NULL;
 
+  return out;
+
+}
+
+static inline SEXP create_aio_msg(SEXP env, SEXP aio, nano_aio *raio, int res) {
+
+  SEXP out, pipe;
+  PROTECT(out = aio_decode(aio, raio));
   PROTECT(pipe = Rf_ScalarInteger(-res));
   Rf_defineVar(nano_ValueSymbol, out, env);
   Rf_defineVar(nano_AioSymbol, pipe, env);
@@ -332,36 +1050,115 @@ SEXP rnng_aio_get_msg(SEXP env) {
   case RECVAIO:
   case REQAIO:
   case IOV_RECVAIO:
-    if (nng_aio_busy(raio->aio))
+    if (nng_aio_busy(raio->aio))
+      return nano_unresolved;
+
+    res = raio->result;
+    if (res > 0)
+      return mk_error_aio(res, env);
+
+    break;
+  case RECVAIOS:
+  case REQAIOS:
+  case IOV_RECVAIOS: {
+    nng_mtx *mtx = ((nano_cv *) raio->next)->mtx;
+    nng_mtx_lock(mtx);
+    res = raio->result;
+    nng_mtx_unlock(mtx);
+
+    if (res == 0)
+      return nano_unresolved;
+
+    if (res > 0)
+      return mk_error_aio(res, env);
+
+    break;
+  }
+  default:
+    /* not reached */
+    res = 0;
+  }
+
+  return create_aio_msg(env, aio, raio, res);
+
+}
+
+// lightweight aio -------------------------------------------------------------
+
+// resolves an Aio created without an environment, caching the received value
+SEXP nano_aio_lite_value(SEXP aio) {
+
+  nano_aio *aiop = (nano_aio *) NANO_PTR(aio);
+  int res;
+
+  switch (aiop->type) {
+  case SENDAIO:
+  case IOV_SENDAIO:
+    if (nng_aio_busy(aiop->aio))
+      return nano_unresolved;
+    return aiop->result > 0 ? mk_error(aiop->result) : nano_success;
+  case RECVAIO:
+  case IOV_RECVAIO:
+    if (aiop->mode == 0)
+      return Rf_getAttrib(aio, nano_ValueSymbol);
+    if (nng_aio_busy(aiop->aio))
       return nano_unresolved;
-
-    res = raio->result;
-    if (res > 0)
-      return mk_error_aio(res, env);
-
+    res = aiop->result;
     break;
   case RECVAIOS:
-  case REQAIOS:
   case IOV_RECVAIOS: {
-    nng_mtx *mtx = ((nano_cv *) raio->next)->mtx;
+    if (aiop->mode == 0)
+      return Rf_getAttrib(aio, nano_ValueSymbol);
+    nng_mtx *mtx = ((nano_cv *) aiop->next)->mtx;
     nng_mtx_lock(mtx);
-    res = raio->result;
+    res = aiop->result;
     nng_mtx_unlock(mtx);
-
     if (res == 0)
       return nano_unresolved;
-
-    if (res > 0)
-      return mk_error_aio(res, env);
-
     break;
   }
   default:
-    /* not reached */
-    res = 0;
+    return R_NilValue;
   }
 
-  return create_aio_msg(env, aio, raio, res);
+  if (res > 0)
+    return mk_error(res);
+
+  SEXP out;
+  PROTECT(out = aio_decode(aio, aiop));
+  Rf_setAttrib(aio, nano_ValueSymbol, out);
+  aiop->mode = 0;
+  UNPROTECT(1);
+  return out;
+
+}
+
+SEXP rnng_aio_lite(SEXP x, SEXP name) {
+
+  if (NANO_PTR_CHECK(x, nano_AioSymbol) || TYPEOF(name) != STRSXP)
+    return R_NilValue;
+
+  nano_aio *aiop = (nano_aio *) NANO_PTR(x);
+  const int send = aiop->type == SENDAIO || aiop->type == IOV_SENDAIO;
+  if (strcmp(CHAR(STRING_ELT(name, 0)), send ? "result" : "data"))
+    return R_NilValue;
+
+  return nano_aio_lite_value(x);
+
+}
+
+SEXP rnng_aio_pool(void) {
+
+  const int n = NANO_POOLS - 1;
+  SEXP out = Rf_allocVector(REALSXP, 3 * n);
+  double *op = REAL(out);
+  for (int i = 0; i < n; i++) {
+    op[i] = aio_pool_hits[i + 1];
+    op[i + n] = aio_pool_misses[i + 1];
+    op[i + 2 * n] = (double) aio_pool_n[i + 1];
+  }
+
+  return out;
 
 }
 
@@ -386,6 +1183,7 @@ SEXP rnng_aio_call(SEXP x) {
       break;
     case SENDAIO:
     case IOV_SENDAIO:
+    case BATCH_SENDAIO:
       nano_aio_result(x);
       break;
     case HTTP_AIO:
@@ -394,6 +1192,12 @@ SEXP rnng_aio_call(SEXP x) {
     }
     break;
   }
+  case EXTPTRSXP:
+    if (NANO_PTR_CHECK(x, nano_AioSymbol))
+      break;
+    nng_aio_wait(((nano_aio *) NANO_PTR(x))->aio);
+    nano_aio_lite_value(x);
+    break;
   case VECSXP: {
     const R_xlen_t xlen = Rf_xlength(x);
     for (R_xlen_t i = 0; i < xlen; i++) {
@@ -418,12 +1222,20 @@ static SEXP rnng_aio_collect_impl(SEXP x, SEXP (*const func)(SEXP)) {
     if (!found) goto fail;
     break;
   }
+  case EXTPTRSXP:
+    if (NANO_PTR_CHECK(x, nano_AioSymbol)) goto fail;
+    out = nano_aio_lite_value(func(x));
+    break;
   case VECSXP: {
     SEXP env, val, names;
     const R_xlen_t xlen = Rf_xlength(x);
     PROTECT(out = Rf_allocVector(VECSXP, xlen));
     for (R_xlen_t i = 0; i < xlen; i++) {
       env = func(VECTOR_PTR_RO(x)[i]);
+      if (TYPEOF(env) == EXTPTRSXP && !NANO_PTR_CHECK(env, nano_AioSymbol)) {
+        SET_VECTOR_ELT(out, i, nano_aio_lite_value(env));
+        continue;
+      }
       if (TYPEOF(env) != ENVSXP) goto fail;
       val = nano_findVarInFrame(env, nano_ValueSymbol, &found);
       if (!found) goto fail;
@@ -466,6 +1278,7 @@ SEXP rnng_aio_stop(SEXP x) {
     if (NANO_PTR_CHECK(coreaio, nano_AioSymbol)) break;
     nano_aio *aiop = (nano_aio *) NANO_PTR(coreaio);
     nng_aio_stop(aiop->aio);
+    fraio_stopped(aiop);
     // See #194, this is to reset the R interrupts state after an interrupt
     // requested by `stop_request()` has already triggered
 #ifdef _WIN32
@@ -475,6 +1288,13 @@ SEXP rnng_aio_stop(SEXP x) {
 #endif
     break;
   }
+  case EXTPTRSXP:
+    if (!NANO_PTR_CHECK(x, nano_AioSymbol)) {
+      nano_aio *aiop = (nano_aio *) NANO_PTR(x);
+      nng_aio_stop(aiop->aio);
+      fraio_stopped(aiop);
+    }
+    break;
   case VECSXP: {
     const R_xlen_t xlen = Rf_xlength(x);
     for (R_xlen_t i = 0; i < xlen; i++) {
@@ -563,6 +1383,7 @@ static int rnng_unresolved_impl(SEXP x) {
     switch (aio->type) {
     case SENDAIO:
     case IOV_SENDAIO:
+    case BATCH_SENDAIO:
       value = rnng_aio_result(x);
       break;
     case HTTP_AIO:
@@ -575,6 +1396,9 @@ static int rnng_unresolved_impl(SEXP x) {
     xc = value == nano_unresolved;
     break;
   }
+  case EXTPTRSXP:
+    xc = !NANO_PTR_CHECK(x, nano_AioSymbol) && nano_aio_lite_value(x) == nano_unresolved;
+    break;
   case LGLSXP:
     xc = x == nano_unresolved;
     break;
@@ -590,6 +1414,7 @@ SEXP rnng_unresolved(SEXP x) {
 
   switch (TYPEOF(x)) {
   case ENVSXP:
+  case EXTPTRSXP:
   case LGLSXP:
     return Rf_ScalarLogical(rnng_unresolved_impl(x));
   case VECSXP: {
@@ -615,6 +1440,9 @@ static int rnng_unresolved2_impl(SEXP x) {
     return nng_aio_busy(aiop->aio);
   }
 
+  if (TYPEOF(x) == EXTPTRSXP && !NANO_PTR_CHECK(x, nano_AioSymbol))
+    return nng_aio_busy(((nano_aio *) NANO_PTR(x))->aio);
+
   return 0;
 
 }
@@ -623,6 +1451,7 @@ SEXP rnng_unresolved2(SEXP x) {
 
   switch (TYPEOF(x)) {
   case ENVSXP:
+  case EXTPTRSXP:
     return Rf_ScalarLogical(rnng_unresolved2_impl(x));
   case VECSXP: {
     int xc = 0;
@@ -643,9 +1472,17 @@ static R_xlen_t race_scan(SEXP x, const R_xlen_t xlen, R_xlen_t *unresolved) {
   R_xlen_t n = 0;
   for (R_xlen_t i = 0; i < xlen; i++) {
     const SEXP elem = VECTOR_PTR_RO(x)[i];
-    if (TYPEOF(elem) != ENVSXP)
+    SEXP coreaio;
+    switch (TYPEOF(elem)) {
+    case ENVSXP:
+      coreaio = nano_findVarInFrame(elem, nano_AioSymbol, NULL);
+      break;
+    case EXTPTRSXP:
+      coreaio = elem;
+      break;
+    default:
       continue;
-    const SEXP coreaio = nano_findVarInFrame(elem, nano_AioSymbol, NULL);
+    }
     if (NANO_PTR_CHECK(coreaio, nano_AioSymbol) ||
         ((nano_aio *) NANO_PTR(coreaio))->result)
       return i + 1;
@@ -726,24 +1563,28 @@ SEXP rnng_send_aio(SEXP con, SEXP data, SEXP mode, SEXP timeout, SEXP pipe, SEXP
   if ((sock = !NANO_PTR_CHECK(con, nano_SocketSymbol)) || !NANO_PTR_CHECK(con, nano_ContextSymbol)) {
 
     const int pipeid = sock ? nano_integer(pipe) : 0;
-    if (raw) {
+    if (raw == 1) {
       nano_encode(&buf, data);
+    } else if (raw == 2) {
+      nano_encode_typed(&buf, data, NANO_HEADROOM);
     } else {
       nano_serialize(&buf, data, NANO_PROT(con), 0, NANO_HEADROOM);
     }
     nng_msg *msg = NULL;
 
-    saio = calloc(1, sizeof(nano_aio));
-    NANO_ENSURE_ALLOC(saio);
+    if ((saio = nano_pool_get(NANO_POOL_SEND)) == NULL) {
+      saio = calloc(1, sizeof(nano_aio));
+      NANO_ENSURE_ALLOC(saio);
+      if ((xc = nng_aio_alloc(&saio->aio, saio_complete, saio)))
+        goto fail;
+      saio->pool = NANO_POOL_SEND;
+    }
     saio->type = SENDAIO;
 
-    if ((xc = nng_msg_alloc(&msg, 0)) ||
-        (xc = nng_aio_alloc(&saio->aio, saio_complete, saio))) {
-      nng_msg_free(msg);
+    if ((xc = nng_msg_alloc(&msg, 0)))
       goto fail;
-    }
 
-    nano_msg_set_body(msg, &buf, raw ? 0 : NANO_HEADROOM);
+    nano_msg_set_body(msg, &buf, raw == 1 ? 0 : NANO_HEADROOM);
 
     if (pipeid) {
       nng_pipe p;
@@ -770,7 +1611,25 @@ SEXP rnng_send_aio(SEXP con, SEXP data, SEXP mode, SEXP timeout, SEXP pipe, SEXP
     saio = calloc(1, sizeof(nano_aio));
     NANO_ENSURE_ALLOC(saio);
 
-    if (nst->msgmode) {
+    if (nst->frm != NULL) {
+      // a single string is framed without its terminating nul
+      const size_t xlen = buf.cur - (TYPEOF(data) == STRSXP && buf.cur);
+      const size_t flen = xlen + nano_frame_overhead(nst->frm);
+      if ((xc = nano_frame_check(nst->frm, xlen)))
+        goto fail;
+      saio->type = IOV_SENDAIO;
+      saio->data = malloc(flen ? flen : 1);
+      NANO_ENSURE_ALLOC(saio->data);
+      nano_frame_write(nst->frm, saio->data, buf.buf, xlen);
+      nng_iov iov = {
+        .iov_buf = saio->data,
+        .iov_len = flen
+      };
+
+      if ((xc = nng_aio_alloc(&saio->aio, isaio_complete, saio)) ||
+          (xc = nng_aio_set_iov(saio->aio, 1u, &iov)))
+        goto fail;
+    } else if (nst->msgmode) {
       nng_msg *msg;
       const size_t xlen = buf.cur - nst->textframes;
       saio->type = SENDAIO;
@@ -785,9 +1644,15 @@ SEXP rnng_send_aio(SEXP con, SEXP data, SEXP mode, SEXP timeout, SEXP pipe, SEXP
       nng_aio_set_msg(saio->aio, msg);
     } else {
       saio->type = IOV_SENDAIO;
-      saio->data = malloc(buf.cur);
-      NANO_ENSURE_ALLOC(saio->data);
-      memcpy(saio->data, buf.buf, buf.cur);
+      if (buf.len) {
+        // data already gathered into its own allocation (e.g. a list) is adopted
+        saio->data = buf.buf;
+        buf.len = 0;
+      } else {
+        saio->data = malloc(buf.cur);
+        NANO_ENSURE_ALLOC(saio->data);
+        memcpy(saio->data, buf.buf, buf.cur);
+      }
       nng_iov iov = {
         .iov_buf = saio->data,
         .iov_len = buf.cur - nst->textframes
@@ -809,6 +1674,12 @@ SEXP rnng_send_aio(SEXP con, SEXP data, SEXP mode, SEXP timeout, SEXP pipe, SEXP
     Rf_error("`con` is not a valid Socket, Context, or Stream");
   }
 
+  if (clo == R_NilValue) {
+    Rf_classgets(aio, nano_liteAio);
+    UNPROTECT(1);
+    return aio;
+  }
+
   PROTECT(env = R_NewEnv(R_NilValue, 0, 0));
   Rf_classgets(env, nano_sendAio);
   Rf_defineVar(nano_AioSymbol, aio, env);
@@ -820,6 +1691,11 @@ SEXP rnng_send_aio(SEXP con, SEXP data, SEXP mode, SEXP timeout, SEXP pipe, SEXP
   return env;
 
   fail:
+  if (saio->pool) {
+    nano_pool_put(saio);
+    saio = NULL;
+    goto failmem;
+  }
   nng_aio_free(saio->aio);
   free(saio->data);
   failmem:
@@ -829,6 +1705,107 @@ SEXP rnng_send_aio(SEXP con, SEXP data, SEXP mode, SEXP timeout, SEXP pipe, SEXP
 
 }
 
+SEXP rnng_send_batch_aio(SEXP con, SEXP data, SEXP mode, SEXP timeout, SEXP pipe, SEXP clo) {
+
+  const int sock = !NANO_PTR_CHECK(con, nano_SocketSymbol);
+  if (!sock && NANO_PTR_CHECK(con, nano_ContextSymbol))
+    Rf_error("`con` is not a valid Socket or Context");
+  if (TYPEOF(data) != VECSXP)
+    Rf_error("`data` must be a list");
+
+  const nng_duration dur = timeout == R_NilValue ? NNG_DURATION_DEFAULT : (nng_duration) nano_integer(timeout);
+  const int raw = nano_encode_mode(mode);
+  const R_xlen_t xlen = XLENGTH(data);
+  const R_xlen_t plen = sock ? Rf_xlength(pipe) : 0;
+  if (plen > 1 && plen != xlen)
+    Rf_error("`pipe` must be of length 1 or the same length as `data`");
+  const int pipeid = plen == 1 ? nano_integer(pipe) : 0;
+  PROTECT(pipe = plen > 1 ? Rf_coerceVector(pipe, INTSXP) : R_NilValue);
+  SEXP aio, env, fun;
+  nano_aio *saio = NULL;
+  nano_batch *b = NULL;
+  nano_buf buf;
+  int xc;
+
+  saio = calloc(1, sizeof(nano_aio));
+  if (saio == NULL) {
+    xc = 2;
+    goto fail;
+  }
+  // the message pointer and status arrays share the allocation of the batch
+  b = calloc(1, sizeof(nano_batch) + xlen * (sizeof(nng_msg *) + sizeof(int)));
+  if (b == NULL) {
+    xc = 2;
+    goto fail;
+  }
+  b->msgs = (nng_msg **) (b + 1);
+  b->status = (int *) (b->msgs + xlen);
+  b->n = xlen;
+  b->sock = sock;
+  if (sock) {
+    b->con.sock = *(nng_socket *) NANO_PTR(con);
+  } else {
+    b->con.ctx = *(nng_ctx *) NANO_PTR(con);
+  }
+  saio->type = BATCH_SENDAIO;
+  saio->data = b;
+
+  if ((xc = nng_aio_alloc(&saio->aio, batch_complete, saio)))
+    goto fail;
+
+  // registered before encoding, so the finalizer frees messages already
+  // created if encoding errors part way through
+  PROTECT(aio = R_MakeExternalPtr(saio, nano_AioSymbol, R_NilValue));
+  R_RegisterCFinalizerEx(aio, batch_finalizer, TRUE);
+
+  const SEXP *data_p = VECTOR_PTR_RO(data);
+  for (R_xlen_t i = 0; i < xlen; i++) {
+    if (raw == 1) {
+      nano_encode(&buf, data_p[i]);
+    } else if (raw == 2) {
+      nano_encode_typed(&buf, data_p[i], NANO_HEADROOM);
+    } else {
+      nano_serialize(&buf, data_p[i], NANO_PROT(con), 0, NANO_HEADROOM);
+    }
+    nng_msg *msg = NULL;
+    if ((xc = nng_msg_alloc(&msg, 0))) {
+      NANO_FREE(buf);
+      b->status[i] = xc;
+      continue;
+    }
+    nano_msg_set_body(msg, &buf, raw == 1 ? 0 : NANO_HEADROOM);
+    NANO_FREE(buf);
+    const int pid = plen > 1 ? INTEGER_RO(pipe)[i] : pipeid;
+    if (pid > 0) {
+      nng_pipe p;
+      p.id = (uint32_t) pid;
+      nng_msg_set_pipe(msg, p);
+    }
+    b->msgs[i] = msg;
+  }
+
+  nng_aio_set_timeout(saio->aio, dur);
+  b->started = 1;
+  batch_next(saio);
+
+  PROTECT(env = R_NewEnv(R_NilValue, 0, 0));
+  Rf_classgets(env, nano_sendAio);
+  Rf_defineVar(nano_AioSymbol, aio, env);
+
+  PROTECT(fun = R_mkClosure(R_NilValue, nano_aioFuncRes, clo));
+  R_MakeActiveBinding(nano_ResultSymbol, fun, env);
+
+  UNPROTECT(4);
+  return env;
+
+  fail:
+  UNPROTECT(1);
+  free(b);
+  free(saio);
+  return mk_error_data(-xc);
+
+}
+
 SEXP rnng_device_aio(SEXP s1, SEXP s2, SEXP clo) {
 
   if (NANO_PTR_CHECK(s1, nano_SocketSymbol))
@@ -873,28 +1850,335 @@ SEXP rnng_device_aio(SEXP s1, SEXP s2, SEXP clo) {
 
 }
 
+static nano_stage_op nano_stage_match(const char *name) {
+
+  const size_t slen = strlen(name);
+  switch (slen) {
+  case 3:
+    if (!memcmp(name, "min", slen)) return STAGE_MIN;
+    if (!memcmp(name, "max", slen)) return STAGE_MAX;
+    break;
+  case 5:
+    if (!memcmp(name, "strip", slen)) return STAGE_STRIP;
+    break;
+  case 6:
+    if (!memcmp(name, "prefix", slen)) return STAGE_PREFIX;
+    break;
+  case 7:
+    if (!memcmp(name, "prepend", slen)) return STAGE_PREPEND;
+    break;
+  }
+
+  Rf_error("`stages` names should be one of: prefix, strip, prepend, min, max");
+
+}
+
+SEXP rnng_pipeline_aio(SEXP from, SEXP to, SEXP stages, SEXP clo) {
+
+  if (NANO_PTR_CHECK(from, nano_SocketSymbol))
+    Rf_error("`from` is not a valid Socket");
+  const int list = TYPEOF(to) == VECSXP;
+  const int n = list ? (int) XLENGTH(to) : 1;
+  if (n == 0)
+    Rf_error("`to` must be a Socket or list of Sockets");
+  for (int i = 0; i < n; i++) {
+    if (NANO_PTR_CHECK(list ? VECTOR_ELT(to, i) : to, nano_SocketSymbol))
+      Rf_error("`to` must be a Socket or list of Sockets");
+  }
+  if (TYPEOF(stages) != VECSXP)
+    Rf_error("`stages` must be a list");
+
+  // validate stages and size their byte buffers before allocating
+  const int nst = (int) XLENGTH(stages);
+  SEXP names = Rf_getAttrib(stages, R_NamesSymbol);
+  if (nst && names == R_NilValue)
+    Rf_error("`stages` must be a named list");
+  size_t bytes = 0;
+  for (int i = 0; i < nst; i++) {
+    const nano_stage_op op = nano_stage_match(CHAR(STRING_ELT(names, i)));
+    SEXP val = VECTOR_ELT(stages, i);
+    if (op == STAGE_PREFIX || op == STAGE_PREPEND) {
+      if (TYPEOF(val) == RAWSXP) {
+        bytes += XLENGTH(val);
+      } else if (TYPEOF(val) == STRSXP && XLENGTH(val)) {
+        bytes += strlen(CHAR(STRING_ELT(val, 0)));
+      } else {
+        Rf_error("`stages` prefix and prepend values must be raw or character");
+      }
+    } else if (nano_integer(val) < 0) {
+      Rf_error("`stages` strip, min and max values must be non-negative integers");
+    }
+  }
+
+  SEXP aio, env, fun, prot;
+  nano_aio *saio = NULL;
+  nano_pipeline *p = NULL;
+  int xc;
+
+  saio = calloc(1, sizeof(nano_aio));
+  NANO_ENSURE_ALLOC(saio);
+  // targets and output messages share the allocation of the pipeline
+  p = calloc(1, sizeof(nano_pipeline) + n * (sizeof(nano_ptarget) + sizeof(nng_msg *)));
+  NANO_ENSURE_ALLOC(p);
+  p->targets = (nano_ptarget *) (p + 1);
+  p->out = (nng_msg **) (p->targets + n);
+  p->n = n;
+  p->from = *(nng_socket *) NANO_PTR(from);
+  // stage buffers share the allocation of the stages
+  p->stages = calloc(1, nst * sizeof(nano_stage) + bytes + 1);
+  NANO_ENSURE_ALLOC(p->stages);
+  p->nstages = nst;
+
+  unsigned char *buf = (unsigned char *) (p->stages + nst);
+  for (int i = 0; i < nst; i++) {
+    nano_stage *st = &p->stages[i];
+    SEXP val = VECTOR_ELT(stages, i);
+    st->op = nano_stage_match(CHAR(STRING_ELT(names, i)));
+    if (st->op == STAGE_PREFIX || st->op == STAGE_PREPEND) {
+      const unsigned char *src = TYPEOF(val) == RAWSXP ? (unsigned char *) NANO_DATAPTR(val) :
+                                 (const unsigned char *) CHAR(STRING_ELT(val, 0));
+      st->len = TYPEOF(val) == RAWSXP ? (size_t) XLENGTH(val) : strlen((const char *) src);
+      st->buf = buf;
+      if (st->len)
+        memcpy(buf, src, st->len);
+      buf += st->len;
+    } else {
+      st->len = (size_t) nano_integer(val);
+    }
+  }
+
+  saio->type = IOV_SENDAIO;
+  saio->data = p;
+
+  if ((xc = nng_mtx_alloc(&p->mtx)) ||
+      (xc = nng_aio_alloc(&p->raio, pipeline_recv_complete, p)) ||
+      (xc = nng_aio_alloc(&saio->aio, pipeline_complete, saio)))
+    goto fail;
+  p->sentinel = saio->aio;
+  for (int i = 0; i < n; i++) {
+    nano_ptarget *t = &p->targets[i];
+    t->p = p;
+    t->sock = *(nng_socket *) NANO_PTR(list ? VECTOR_ELT(to, i) : to);
+    if ((xc = nng_aio_alloc(&t->aio, pipeline_send_complete, t)))
+      goto fail;
+  }
+
+  // the sentinel remains pending for the life of the pipeline
+  nng_aio_begin(saio->aio);
+  nng_aio_defer(saio->aio, sentinel_cancel, p);
+  nng_recv_aio(p->from, p->raio);
+
+  // keep all sockets alive for as long as the running pipeline references them
+  PROTECT(prot = Rf_list2(from, to));
+  PROTECT(aio = R_MakeExternalPtr(saio, nano_AioSymbol, prot));
+  R_RegisterCFinalizerEx(aio, pipeline_finalizer, TRUE);
+  Rf_setAttrib(aio, nano_PipelineSymbol, from);
+
+  PROTECT(env = R_NewEnv(R_NilValue, 0, 0));
+  Rf_classgets(env, nano_sendAio);
+  Rf_defineVar(nano_AioSymbol, aio, env);
+
+  PROTECT(fun = R_mkClosure(R_NilValue, nano_aioFuncRes, clo));
+  R_MakeActiveBinding(nano_ResultSymbol, fun, env);
+
+  UNPROTECT(4);
+  return env;
+
+  fail:
+  for (int i = 0; i < n; i++)
+    nng_aio_free(p->targets[i].aio);
+  nng_aio_free(saio->aio);
+  nng_aio_free(p->raio);
+  nng_mtx_free(p->mtx);
+  failmem:
+  if (p != NULL)
+    free(p->stages);
+  free(p);
+  free(saio);
+  return mk_error_data(-xc);
+
+}
+
+static int nano_routing_mode(SEXP routing) {
+
+  if (TYPEOF(routing) == INTSXP)
+    return NANO_INTEGER(routing) == 2;
+
+  const char *rte = CHAR(STRING_ELT(routing, 0));
+  const size_t slen = strlen(rte);
+
+  switch (slen) {
+  case 5:
+    if (!memcmp(rte, "least", slen)) return 1;
+    break;
+  case 11:
+    if (!memcmp(rte, "round-robin", slen)) return 0;
+    break;
+  }
+
+  Rf_error("`routing` should be one of: round-robin, least");
+
+}
+
+SEXP rnng_broker_aio(SEXP frontend, SEXP backends, SEXP routing, SEXP clo) {
+
+  if (NANO_PTR_CHECK(frontend, nano_SocketSymbol))
+    Rf_error("`frontend` is not a valid Socket");
+  const int list = TYPEOF(backends) == VECSXP;
+  const int n = list ? (int) XLENGTH(backends) : 1;
+  if (n == 0)
+    Rf_error("`backends` must be a Socket or list of Sockets");
+  for (int i = 0; i < n; i++) {
+    if (NANO_PTR_CHECK(list ? VECTOR_ELT(backends, i) : backends, nano_SocketSymbol))
+      Rf_error("`backends` must be a Socket or list of Sockets");
+  }
+  const int least = nano_routing_mode(routing);
+
+  SEXP aio, env, fun, prot;
+  nano_aio *saio = NULL;
+  nano_broker *b = NULL;
+  int xc;
+
+  saio = calloc(1, sizeof(nano_aio));
+  NANO_ENSURE_ALLOC(saio);
+  // the frontend and backends share the allocation of the broker
+  b = calloc(1, sizeof(nano_broker) + (n + 1) * sizeof(nano_bside));
+  NANO_ENSURE_ALLOC(b);
+  b->sides = (nano_bside *) (b + 1);
+  b->n = n;
+  b->next = 1;
+  b->least = least;
+  saio->type = IOV_SENDAIO;
+  saio->data = b;
+
+  if ((xc = nng_mtx_alloc(&b->mtx)) ||
+      (xc = nng_aio_alloc(&saio->aio, broker_complete, saio)))
+    goto fail;
+  b->sentinel = saio->aio;
+
+  for (int i = 0; i <= n; i++) {
+    nano_bside *side = &b->sides[i];
+    side->b = b;
+    if (i == 0) {
+      side->sock = *(nng_socket *) NANO_PTR(frontend);
+      if ((xc = nng_aio_alloc(&side->recv, broker_front_complete, side)))
+        goto fail;
+    } else {
+      side->sock = *(nng_socket *) NANO_PTR(list ? VECTOR_ELT(backends, i - 1) : backends);
+      if ((xc = nng_aio_alloc(&side->send, broker_send_complete, side)) ||
+          (xc = nng_aio_alloc(&side->recv, broker_recv_complete, side)) ||
+          (xc = nng_aio_alloc(&side->reply, broker_reply_complete, side)))
+        goto fail;
+    }
+  }
+
+  // the sentinel remains pending for the life of the broker
+  nng_aio_begin(saio->aio);
+  nng_aio_defer(saio->aio, sentinel_cancel, b);
+  for (int i = 0; i <= n; i++)
+    nng_recv_aio(b->sides[i].sock, b->sides[i].recv);
+
+  // keep all sockets alive for as long as the running broker references them
+  PROTECT(prot = Rf_list2(frontend, backends));
+  PROTECT(aio = R_MakeExternalPtr(saio, nano_AioSymbol, prot));
+  R_RegisterCFinalizerEx(aio, broker_finalizer, TRUE);
+  Rf_setAttrib(aio, nano_BrokerSymbol, frontend);
+
+  PROTECT(env = R_NewEnv(R_NilValue, 0, 0));
+  Rf_classgets(env, nano_sendAio);
+  Rf_defineVar(nano_AioSymbol, aio, env);
+
+  PROTECT(fun = R_mkClosure(R_NilValue, nano_aioFuncRes, clo));
+  R_MakeActiveBinding(nano_ResultSymbol, fun, env);
+
+  UNPROTECT(4);
+  return env;
+
+  fail:
+  for (int i = 0; i <= n; i++) {
+    nng_aio_free(b->sides[i].send);
+    nng_aio_free(b->sides[i].recv);
+    nng_aio_free(b->sides[i].reply);
+  }
+  nng_aio_free(saio->aio);
+  nng_mtx_free(b->mtx);
+  failmem:
+  free(b);
+  free(saio);
+  return mk_error_data(-xc);
+
+}
+
+SEXP rnng_broker_stats(SEXP x) {
+
+  const SEXP coreaio = TYPEOF(x) == ENVSXP ? nano_findVarInFrame(x, nano_AioSymbol, NULL) : x;
+  if (NANO_PTR_CHECK(coreaio, nano_AioSymbol) || Rf_getAttrib(coreaio, nano_BrokerSymbol) == R_NilValue)
+    Rf_error("`x` is not a valid Broker");
+
+  nano_broker *b = (nano_broker *) ((nano_aio *) NANO_PTR(coreaio))->data;
+  const int nr = b->n + 1;
+  SEXP out = Rf_allocMatrix(REALSXP, nr, 5);
+  double *op = REAL(out);
+
+  nng_mtx_lock(b->mtx);
+  for (int i = 0; i < nr; i++) {
+    for (int j = 0; j < 4; j++)
+      op[i + j * nr] = b->sides[i].stats[j];
+    op[i + 4 * nr] = (double) b->sides[i].depth;
+  }
+  nng_mtx_unlock(b->mtx);
+
+  return out;
+
+}
+
+SEXP rnng_pipeline_stats(SEXP x) {
+
+  const SEXP coreaio = TYPEOF(x) == ENVSXP ? nano_findVarInFrame(x, nano_AioSymbol, NULL) : x;
+  if (NANO_PTR_CHECK(coreaio, nano_AioSymbol) || Rf_getAttrib(coreaio, nano_PipelineSymbol) == R_NilValue)
+    Rf_error("`x` is not a valid Pipeline");
+
+  nano_pipeline *p = (nano_pipeline *) ((nano_aio *) NANO_PTR(coreaio))->data;
+  SEXP out = Rf_allocVector(REALSXP, 4);
+
+  nng_mtx_lock(p->mtx);
+  memcpy(REAL(out), p->stats, sizeof(p->stats));
+  nng_mtx_unlock(p->mtx);
+
+  return out;
+
+}
+
 SEXP rnng_recv_aio(SEXP con, SEXP mode, SEXP timeout, SEXP cvar, SEXP clo) {
 
   const nng_duration dur = timeout == R_NilValue ? NNG_DURATION_DEFAULT : (nng_duration) nano_integer(timeout);
   const int signal = cvar != R_NilValue && !NANO_PTR_CHECK(cvar, nano_CvSymbol);
   const int interrupt = TYPEOF(cvar) == SYMSXP;
   nano_cv *ncv = signal ? (nano_cv *) NANO_PTR(cvar) : NULL;
+  nano_cq *cq = signal ? ncv->cq : NULL;
   nano_aio *raio = NULL;
   SEXP aio, env, fun;
   int sock, xc;
 
+  if (cq != NULL)
+    nano_cq_ensure(cvar);
+
   if ((sock = !NANO_PTR_CHECK(con, nano_SocketSymbol)) || !NANO_PTR_CHECK(con, nano_ContextSymbol)) {
 
     const uint8_t mod = nano_matcharg(mode);
-    raio = calloc(1, sizeof(nano_aio));
-    NANO_ENSURE_ALLOC(raio);
+    if (interrupt || (raio = nano_pool_get(NANO_POOL_RECV)) == NULL) {
+      raio = calloc(1, sizeof(nano_aio));
+      NANO_ENSURE_ALLOC(raio);
+      if ((xc = nng_aio_alloc(&raio->aio, interrupt ? raio_complete_interrupt : raio_complete, raio)))
+        goto fail;
+      raio->pool = interrupt ? NANO_POOL_NONE : NANO_POOL_RECV;
+    }
     raio->next = ncv;
     raio->type = signal ? RECVAIOS : RECVAIO;
     raio->mode = mod;
 
-    if ((xc = nng_aio_alloc(&raio->aio, interrupt ? raio_complete_interrupt : raio_complete, raio)))
-      goto fail;
-
+    if (cq != NULL)
+      raio->qid = NANO_CQ_PENDING;
     nng_aio_set_timeout(raio->aio, dur);
     sock ? nng_recv_aio(*(nng_socket *) NANO_PTR(con), raio->aio) :
       nng_ctx_recv(*(nng_ctx *) NANO_PTR(con), raio->aio);
@@ -915,15 +2199,35 @@ SEXP rnng_recv_aio(SEXP con, SEXP mode, SEXP timeout, SEXP cvar, SEXP clo) {
     raio->next = ncv;
     raio->mode = mod;
 
-    if (nst->msgmode) {
+    if (nst->frm != NULL) {
+      nano_framer *f = nst->frm;
+      raio->type = signal ? RECVAIOS : RECVAIO;
+      raio->framed = 1;
+      if ((xc = nng_aio_alloc(&raio->aio, fraio_complete, raio)))
+        goto fail;
+      nng_mtx_lock(f->mtx);
+      if (!(xc = f->busy ? NNG_EBUSY : 0)) {
+        f->busy = 1;
+        f->refs++;
+      }
+      nng_mtx_unlock(f->mtx);
+      if (xc)
+        goto fail;
+      raio->data = f;
+    } else if (nst->msgmode) {
       raio->type = signal ? RECVAIOS : RECVAIO;
       if ((xc = nng_aio_alloc(&raio->aio, raio_complete, raio)))
         goto fail;
     } else {
       size_t xlen = nst->bufsize;
       raio->type = signal ? IOV_RECVAIOS : IOV_RECVAIO;
-      raio->data = malloc(xlen);
-      NANO_ENSURE_ALLOC(raio->data);
+      if ((raio->data = nano_arena_take(nst->arena, &xlen)) != NULL) {
+        raio->arena = nst->arena;
+      } else {
+        xlen = nst->bufsize;
+        raio->data = malloc(xlen);
+        NANO_ENSURE_ALLOC(raio->data);
+      }
       nng_iov iov = {
         .iov_buf = raio->data,
         .iov_len = xlen
@@ -933,16 +2237,31 @@ SEXP rnng_recv_aio(SEXP con, SEXP mode, SEXP timeout, SEXP cvar, SEXP clo) {
         goto fail;
     }
 
+    if (cq != NULL)
+      raio->qid = NANO_CQ_PENDING;
     nng_aio_set_timeout(raio->aio, dur);
-    nng_stream_recv(sp, raio->aio);
+    if (nst->frm == NULL) {
+      nng_stream_recv(sp, raio->aio);
+    } else if (nng_aio_begin(raio->aio)) {
+      // completes at once, so that any frame already buffered is taken first
+      nng_aio_finish(raio->aio, 0);
+    }
 
     PROTECT(aio = R_MakeExternalPtr(raio, nano_AioSymbol, R_NilValue));
-    R_RegisterCFinalizerEx(aio, nst->msgmode ? raio_finalizer : iaio_finalizer, TRUE);
+    R_RegisterCFinalizerEx(aio, nst->frm != NULL ? fraio_finalizer : nst->msgmode ? raio_finalizer : iaio_finalizer, TRUE);
 
   } else {
     Rf_error("`con` is not a valid Socket, Context or Stream");
   }
 
+  if (clo == R_NilValue) {
+    Rf_classgets(aio, nano_liteAio);
+    if (cq != NULL)
+      nano_cq_register(cvar, &raio->qid, aio);
+    UNPROTECT(1);
+    return aio;
+  }
+
   PROTECT(env = R_NewEnv(R_NilValue, 0, 0));
   Rf_classgets(env, nano_recvAio);
   Rf_defineVar(nano_AioSymbol, aio, env);
@@ -950,12 +2269,19 @@ SEXP rnng_recv_aio(SEXP con, SEXP mode, SEXP timeout, SEXP cvar, SEXP clo) {
   PROTECT(fun = R_mkClosure(R_NilValue, nano_aioFuncMsg, clo));
   R_MakeActiveBinding(nano_DataSymbol, fun, env);
 
+  if (cq != NULL)
+    nano_cq_register(cvar, &raio->qid, env);
+
   UNPROTECT(3);
   return env;
 
   fail:
   nng_aio_free(raio->aio);
-  free(raio->data);
+  if (raio->arena != NULL) {
+    nano_arena_give(raio->arena, 0);
+  } else {
+    free(raio->data);
+  }
   failmem:
   free(raio);
   return mk_error_data(xc);
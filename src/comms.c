@@ -1,5 +1,6 @@
 // nanonext - C level - Communications Functions -------------------------------
 
+#define NANONEXT_IO
 #include "nanonext.h"
 
 // internal --------------------------------------------------------------------
@@ -26,13 +27,42 @@ static int nano_fail_mode(SEXP mode) {
 
 }
 
+// takes the aio cached on a connection, or a new one if it is already in use
+static int nano_sync_take(nano_syncaio *s, nng_aio **aiop) {
+
+  int xc;
+  if (s->busy)
+    return nng_aio_alloc(aiop, NULL, NULL);
+
+  if (s->aio == NULL && (xc = nng_aio_alloc(&s->aio, NULL, NULL)))
+    return xc;
+
+  s->busy = 1;
+  *aiop = s->aio;
+  return 0;
+
+}
+
+// returns an aio from nano_sync_take() once its operation has completed
+static void nano_sync_give(nano_syncaio *s, nng_aio *aiop) {
+
+  if (aiop != s->aio) {
+    nng_aio_free(aiop);
+    return;
+  }
+  nng_aio_set_msg(aiop, NULL);
+  s->busy = 0;
+
+}
+
 // finalizers ------------------------------------------------------------------
 
 static void context_finalizer(SEXP xptr) {
 
   if (NANO_PTR(xptr) == NULL) return;
-  nng_ctx *xp = (nng_ctx *) NANO_PTR(xptr);
-  nng_ctx_close(*xp);
+  nano_sockctx *xp = (nano_sockctx *) NANO_PTR(xptr);
+  nng_ctx_close(xp->ctx);
+  nng_aio_free(xp->sync.aio);
   free(xp);
 
 }
@@ -47,7 +77,7 @@ SEXP rnng_ctx_open(SEXP socket) {
   nng_socket *sock = (nng_socket *) NANO_PTR(socket);
   SEXP context;
   int xc;
-  nng_ctx *ctx = malloc(sizeof(nng_ctx));
+  nng_ctx *ctx = calloc(1, sizeof(nano_sockctx));
   NANO_ENSURE_ALLOC(ctx);
 
   if ((xc = nng_ctx_open(ctx, *sock)))
@@ -80,7 +110,7 @@ SEXP rnng_ctx_create(SEXP socket) {
   nng_socket *sock = (nng_socket *) NANO_PTR(socket);
   SEXP context;
   int xc;
-  nng_ctx *ctx = malloc(sizeof(nng_ctx));
+  nng_ctx *ctx = calloc(1, sizeof(nano_sockctx));
   NANO_ENSURE_ALLOC(ctx);
 
   if ((xc = nng_ctx_open(ctx, *sock)))
@@ -354,6 +384,292 @@ SEXP rnng_listener_close(SEXP listener) {
 
 }
 
+// stream framing --------------------------------------------------------------
+
+nano_framer *nano_framer_alloc(const nano_framing framing, const size_t max) {
+
+  nano_framer *f = calloc(1, sizeof(nano_framer));
+  if (f == NULL)
+    return NULL;
+  if (nng_mtx_alloc(&f->mtx)) {
+    free(f);
+    return NULL;
+  }
+  f->framing = framing;
+  f->max = max;
+  f->refs = 1;
+
+  return f;
+
+}
+
+void nano_framer_release(nano_framer *f) {
+
+  nng_mtx_lock(f->mtx);
+  const int refs = --f->refs;
+  nng_mtx_unlock(f->mtx);
+  if (refs)
+    return;
+
+  nng_mtx_free(f->mtx);
+  free(f->buf);
+  free(f);
+
+}
+
+// lends the arena of an unframed Stream, if not already in use. It starts at
+// up to NANO_ARENA_INIT bytes, the whole of a default 'buffer', and doubles
+// (up to 'buffer') each time a read fills it, adapting to observed read sizes
+unsigned char *nano_arena_take(nano_framer *a, size_t *cap) {
+
+  nng_mtx_lock(a->mtx);
+  const int avail = !a->busy && !a->closed;
+  if (avail) {
+    a->busy = 1;
+    a->refs++;
+  }
+  nng_mtx_unlock(a->mtx);
+  if (!avail)
+    return NULL;
+
+  size_t want = a->cap;
+  if (want == 0) {
+    want = a->max < NANO_ARENA_INIT ? a->max : NANO_ARENA_INIT;
+  } else if (a->len == a->cap && a->cap < a->max) {
+    want = a->cap < a->max / 2 ? a->cap * 2 : a->max;
+  }
+  if (want != a->cap) {
+    unsigned char *buf = malloc(want);
+    if (buf == NULL) {
+      nano_arena_give(a, 0);
+      return NULL;
+    }
+    free(a->buf);
+    a->buf = buf;
+    a->cap = want;
+  }
+  *cap = a->cap;
+
+  return a->buf;
+
+}
+
+void nano_arena_give(nano_framer *a, const size_t used) {
+
+  a->len = used;
+  nng_mtx_lock(a->mtx);
+  a->busy = 0;
+  nng_mtx_unlock(a->mtx);
+  nano_framer_release(a);
+
+}
+
+// an oversize frame cannot be skipped without reading it through, so the
+// buffered bytes are discarded and the Stream closed, failing later receives
+static int nano_frame_fail(nano_framer *f) {
+
+  f->head = 0;
+  f->len = 0;
+  f->failed = 1;
+  nng_stream_close(f->stream);
+
+  return NNG_EMSGSIZE;
+
+}
+
+// takes one complete frame from the buffer: 0 on success, -1 if more bytes
+// are required, or else an NNG error code
+int nano_frame_take(nano_framer *f, nng_msg **msgp) {
+
+  if (f->failed)
+    return NNG_ECLOSED;
+
+  unsigned char *p = f->buf + f->head;
+  size_t skip, flen, tail = 0;
+
+  switch (f->framing) {
+  case NANO_FRAME_U32:
+  case NANO_FRAME_U64: {
+    skip = f->framing == NANO_FRAME_U32 ? 4 : 8;
+    if (f->len < skip)
+      return -1;
+    uint64_t n = 0;
+    for (size_t i = 0; i < skip; i++)
+      n = (n << 8) | p[i];
+    if (n > f->max)
+      return nano_frame_fail(f);
+    flen = (size_t) n;
+    if (f->len < skip + flen)
+      return -1;
+    break;
+  }
+  case NANO_FRAME_LF:
+  case NANO_FRAME_CRLF: {
+    skip = 0;
+    unsigned char *q = f->len ? memchr(p, '\n', f->len) : NULL;
+    if (f->framing == NANO_FRAME_CRLF) {
+      while (q != NULL && (q == p || q[-1] != '\r'))
+        q = memchr(q + 1, '\n', f->len - (size_t) (q + 1 - p));
+    }
+    if (q == NULL)
+      return f->len > f->max + 1 ? nano_frame_fail(f) : -1;
+    tail = f->framing == NANO_FRAME_CRLF ? 2 : 1;
+    flen = (size_t) (q - p) + 1 - tail;
+    if (flen > f->max)
+      return nano_frame_fail(f);
+    break;
+  }
+  default:
+    skip = 0;
+    flen = f->max;
+    if (f->len < flen)
+      return -1;
+  }
+
+  int xc;
+  if ((xc = nng_msg_alloc(msgp, flen)))
+    return xc;
+  if (flen)
+    memcpy(nng_msg_body(*msgp), p + skip, flen);
+  f->head += skip + flen + tail;
+  f->len -= skip + flen + tail;
+  if (f->len == 0)
+    f->head = 0;
+
+  return 0;
+
+}
+
+// points the Aio at the free space following any partial frame in the buffer
+int nano_frame_prep(nano_framer *f, nng_aio *aio) {
+
+  if (f->buf == NULL) {
+    f->cap = f->max + 8;
+    f->buf = malloc(f->cap);
+    if (f->buf == NULL)
+      return NNG_ENOMEM;
+  }
+  if (f->head) {
+    memmove(f->buf, f->buf + f->head, f->len);
+    f->head = 0;
+  }
+  if (f->len == f->cap)
+    return NNG_EMSGSIZE;
+
+  nng_iov iov = {
+    .iov_buf = f->buf + f->len,
+    .iov_len = f->cap - f->len
+  };
+
+  return nng_aio_set_iov(aio, 1u, &iov);
+
+}
+
+// receives up to n frames, waiting only for the first
+int nano_frame_recv(nano_stream *nst, nng_msg **msgs, const int n, const nng_duration dur) {
+
+  nano_framer *f = nst->frm;
+  nng_aio *aiop = NULL;
+  int count = 0, xc;
+
+  nng_mtx_lock(f->mtx);
+  xc = f->busy ? NNG_EBUSY : 0;
+  f->busy = 1;
+  nng_mtx_unlock(f->mtx);
+  if (xc)
+    return -xc;
+
+  while ((xc = nano_frame_take(f, &msgs[0])) < 0) {
+    if (aiop == NULL) {
+      if ((xc = nano_sync_take(&nst->sync, &aiop)))
+        break;
+      nng_aio_set_timeout(aiop, dur);
+    }
+    if ((xc = nano_frame_prep(f, aiop)))
+      break;
+    nng_stream_recv(nst->stream, aiop);
+    nng_aio_wait(aiop);
+    if ((xc = nng_aio_result(aiop)))
+      break;
+    f->len += nng_aio_count(aiop);
+  }
+  if (xc == 0) {
+    count = 1;
+    while (count < n && nano_frame_take(f, &msgs[count]) == 0)
+      count++;
+  }
+  if (aiop != NULL)
+    nano_sync_give(&nst->sync, aiop);
+
+  nng_mtx_lock(f->mtx);
+  f->busy = 0;
+  nng_mtx_unlock(f->mtx);
+
+  return xc ? -xc : count;
+
+}
+
+size_t nano_frame_overhead(const nano_framer *f) {
+
+  switch (f->framing) {
+  case NANO_FRAME_U32: return 4;
+  case NANO_FRAME_U64: return 8;
+  case NANO_FRAME_LF: return 1;
+  case NANO_FRAME_CRLF: return 2;
+  default: return 0;
+  }
+
+}
+
+// checks that len bytes may be sent as a single frame: a whole number of
+// records for fixed framing, or within the range of a u32 length prefix
+int nano_frame_check(const nano_framer *f, const size_t len) {
+
+  if (f->framing == NANO_FRAME_FIXED && len % f->max)
+    return NNG_EINVAL;
+  if (f->framing == NANO_FRAME_U32 && (uint64_t) len > UINT32_MAX)
+    return NNG_EMSGSIZE;
+
+  return 0;
+
+}
+
+// writes the length prefix or delimiter framing len bytes to hdr, returning
+// its size
+size_t nano_frame_header(const nano_framer *f, unsigned char *hdr, const size_t len) {
+
+  switch (f->framing) {
+  case NANO_FRAME_U32:
+  case NANO_FRAME_U64: {
+    const size_t n = f->framing == NANO_FRAME_U32 ? 4 : 8;
+    for (size_t i = 0; i < n; i++)
+      hdr[i] = (unsigned char) ((uint64_t) len >> (8 * (n - 1 - i)));
+    return n;
+  }
+  case NANO_FRAME_CRLF:
+    hdr[0] = '\r';
+    hdr[1] = '\n';
+    return 2;
+  case NANO_FRAME_LF:
+    hdr[0] = '\n';
+    return 1;
+  default:
+    return 0;
+  }
+
+}
+
+// writes len bytes of src to dst as a frame, dst having room for the overhead
+void nano_frame_write(const nano_framer *f, unsigned char *dst, const unsigned char *src, const size_t len) {
+
+  const size_t skip = NANO_FRAME_PREFIXED(f) ? nano_frame_header(f, dst, len) : 0;
+  if (len)
+    memcpy(dst + skip, src, len);
+  if (!skip)
+    nano_frame_header(f, dst + len, len);
+
+}
+
 // send and recv ---------------------------------------------------------------
 
 SEXP rnng_send(SEXP con, SEXP data, SEXP mode, SEXP block, SEXP pipe) {
@@ -366,8 +682,10 @@ SEXP rnng_send(SEXP con, SEXP data, SEXP mode, SEXP block, SEXP pipe) {
   if ((sock = !NANO_PTR_CHECK(con, nano_SocketSymbol)) || !NANO_PTR_CHECK(con, nano_ContextSymbol)) {
 
     const int pipeid = sock ? nano_integer(pipe) : 0;
-    if (raw) {
+    if (raw == 1) {
       nano_encode(&buf, data);
+    } else if (raw == 2) {
+      nano_encode_typed(&buf, data, NANO_HEADROOM);
     } else {
       nano_serialize(&buf, data, NANO_PROT(con), 0, NANO_HEADROOM);
     }
@@ -376,7 +694,7 @@ SEXP rnng_send(SEXP con, SEXP data, SEXP mode, SEXP block, SEXP pipe) {
     if ((xc = nng_msg_alloc(&msgp, 0)))
       goto fail;
 
-    nano_msg_set_body(msgp, &buf, raw ? 0 : NANO_HEADROOM);
+    nano_msg_set_body(msgp, &buf, raw == 1 ? 0 : NANO_HEADROOM);
 
     if (pipeid) {
       nng_pipe p;
@@ -396,41 +714,79 @@ SEXP rnng_send(SEXP con, SEXP data, SEXP mode, SEXP block, SEXP pipe) {
 
     } else {
 
+      nano_sockctx *hd = (nano_sockctx *) NANO_PTR(con);
       nng_aio *aiop = NULL;
 
-      if ((xc = nng_aio_alloc(&aiop, NULL, NULL))) {
+      if ((xc = nano_sync_take(&hd->sync, &aiop))) {
         nng_msg_free(msgp);
         goto fail;
       }
 
       nng_aio_set_msg(aiop, msgp);
       nng_aio_set_timeout(aiop, flags);
-      sock ? nng_send_aio(*(nng_socket *) NANO_PTR(con), aiop) :
-             nng_ctx_send(*(nng_ctx *) NANO_PTR(con), aiop);
+      sock ? nng_send_aio(hd->sock, aiop) : nng_ctx_send(hd->ctx, aiop);
       NANO_FREE(buf);
       nng_aio_wait(aiop);
       if ((xc = nng_aio_result(aiop)))
         nng_msg_free(nng_aio_get_msg(aiop));
-      nng_aio_free(aiop);
+      nano_sync_give(&hd->sync, aiop);
 
     }
 
   } else if (!NANO_PTR_CHECK(con, nano_StreamSymbol)) {
 
-    nano_encode(&buf, data);
-
     nano_stream *nst = (nano_stream *) NANO_PTR(con);
     nng_stream *sp = nst->stream;
     nng_aio *aiop = NULL;
+    unsigned char *frame = NULL;
+    // a list is sent vectored from the vectors themselves where possible
+    nng_iov iovs[NANO_IOV_MAX];
+    unsigned char hdr[8];
+    const int niov = TYPEOF(data) == VECSXP && !nst->msgmode ? nano_encode_iov(nst->frm, iovs, hdr, data) : 0;
+
+    if (niov) {
+      NANO_INIT(&buf, NULL, 0);
+    } else {
+      nano_encode(&buf, data);
+    }
 
-    if ((xc = nng_aio_alloc(&aiop, NULL, NULL)))
+    if (niov < 0) {
+      xc = -niov;
       goto fail;
+    }
 
-    if (nst->msgmode) {
+    if ((xc = nano_sync_take(&nst->sync, &aiop)))
+      goto fail;
+
+    if (niov) {
+      if ((xc = nng_aio_set_iov(aiop, (unsigned) niov, iovs))) {
+        nano_sync_give(&nst->sync, aiop);
+        goto fail;
+      }
+    } else if (nst->frm != NULL) {
+      // a single string is framed without its terminating nul
+      const size_t xlen = buf.cur - (TYPEOF(data) == STRSXP && buf.cur);
+      const size_t flen = xlen + nano_frame_overhead(nst->frm);
+      if ((xc = nano_frame_check(nst->frm, xlen)) == 0 && (frame = malloc(flen ? flen : 1)) == NULL) {
+        xc = NNG_ENOMEM;
+      } else if (xc == 0) {
+        nano_frame_write(nst->frm, frame, buf.buf, xlen);
+        nng_iov iov = {
+          .iov_buf = frame,
+          .iov_len = flen
+        };
+        xc = nng_aio_set_iov(aiop, 1u, &iov);
+      }
+      if (xc) {
+        free(frame);
+        nano_sync_give(&nst->sync, aiop);
+        goto fail;
+      }
+    } else if (nst->msgmode) {
       nng_msg *msgp;
       const size_t xlen = buf.cur - nst->textframes;
       if ((xc = nng_msg_alloc(&msgp, xlen))) {
-        nng_aio_free(aiop);
+        nano_sync_give(&nst->sync, aiop);
         goto fail;
       }
       memcpy(nng_msg_body(msgp), buf.buf, xlen);
@@ -441,7 +797,7 @@ SEXP rnng_send(SEXP con, SEXP data, SEXP mode, SEXP block, SEXP pipe) {
         .iov_len = buf.cur - nst->textframes
       };
       if ((xc = nng_aio_set_iov(aiop, 1u, &iov))) {
-        nng_aio_free(aiop);
+        nano_sync_give(&nst->sync, aiop);
         goto fail;
       }
     }
@@ -452,7 +808,8 @@ SEXP rnng_send(SEXP con, SEXP data, SEXP mode, SEXP block, SEXP pipe) {
     nng_aio_wait(aiop);
     if ((xc = nng_aio_result(aiop)) && nst->msgmode)
       nng_msg_free(nng_aio_get_msg(aiop));
-    nng_aio_free(aiop);
+    nano_sync_give(&nst->sync, aiop);
+    free(frame);
 
   } else {
     Rf_error("`con` is not a valid Socket, Context or Stream");
@@ -469,6 +826,22 @@ SEXP rnng_send(SEXP con, SEXP data, SEXP mode, SEXP block, SEXP pipe) {
 
 }
 
+SEXP nano_arena_decode(void *data) {
+
+  nano_adecode *d = (nano_adecode *) data;
+  return nano_decode(d->buf, d->sz, d->mod, d->hook);
+
+}
+
+// returns the arena whether or not decoding completes, as an error would
+// otherwise leave it lent
+void nano_arena_cleanup(void *data, Rboolean jump) {
+
+  nano_adecode *d = (nano_adecode *) data;
+  nano_arena_give(d->arena, d->sz);
+
+}
+
 SEXP rnng_recv(SEXP con, SEXP mode, SEXP block) {
 
   const int flags = block == R_NilValue ? NNG_DURATION_DEFAULT : TYPEOF(block) == LGLSXP ? 0 : nano_integer(block);
@@ -490,18 +863,19 @@ SEXP rnng_recv(SEXP con, SEXP mode, SEXP block) {
       
     } else {
 
+      nano_syncaio *sync = &((nano_sockctx *) sock)->sync;
       nng_aio *aiop = NULL;
-      if ((xc = nng_aio_alloc(&aiop, NULL, NULL)))
+      if ((xc = nano_sync_take(sync, &aiop)))
         goto fail;
       nng_aio_set_timeout(aiop, flags);
       nng_recv_aio(*sock, aiop);
       nng_aio_wait(aiop);
       if ((xc = nng_aio_result(aiop))) {
-        nng_aio_free(aiop);
+        nano_sync_give(sync, aiop);
         goto fail;
       }
       msgp = nng_aio_get_msg(aiop);
-      nng_aio_free(aiop);
+      nano_sync_give(sync, aiop);
     }
     buf = nng_msg_body(msgp);
     sz = nng_msg_len(msgp);
@@ -526,21 +900,22 @@ SEXP rnng_recv(SEXP con, SEXP mode, SEXP block) {
 
     } else {
 
+      nano_syncaio *sync = &((nano_sockctx *) ctxp)->sync;
       nng_aio *aiop = NULL;
 
-      if ((xc = nng_aio_alloc(&aiop, NULL, NULL)))
+      if ((xc = nano_sync_take(sync, &aiop)))
         goto fail;
       nng_aio_set_timeout(aiop, flags);
       nng_ctx_recv(*ctxp, aiop);
 
       nng_aio_wait(aiop);
       if ((xc = nng_aio_result(aiop))) {
-        nng_aio_free(aiop);
+        nano_sync_give(sync, aiop);
         goto fail;
       }
 
       msgp = nng_aio_get_msg(aiop);
-      nng_aio_free(aiop);
+      nano_sync_give(sync, aiop);
       buf = nng_msg_body(msgp);
       sz = nng_msg_len(msgp);
       res = nano_decode(buf, sz, mod, NANO_PROT(con));
@@ -557,7 +932,19 @@ SEXP rnng_recv(SEXP con, SEXP mode, SEXP block) {
     nng_stream *sp = nst->stream;
     nng_aio *aiop = NULL;
 
-    if ((xc = nng_aio_alloc(&aiop, NULL, NULL)))
+    if (nst->frm != NULL) {
+      nng_msg *msgp;
+      const int n = nano_frame_recv(nst, &msgp, 1, flags ? flags : (NANO_INTEGER(block) != 0) * NNG_DURATION_DEFAULT);
+      if (n < 0) {
+        xc = -n;
+        goto fail;
+      }
+      res = nano_decode(nng_msg_body(msgp), nng_msg_len(msgp), mod, NANO_PROT(con));
+      nng_msg_free(msgp);
+      return res;
+    }
+
+    if ((xc = nano_sync_take(&nst->sync, &aiop)))
       goto fail;
 
     if (nst->msgmode) {
@@ -566,38 +953,53 @@ SEXP rnng_recv(SEXP con, SEXP mode, SEXP block) {
       nng_stream_recv(sp, aiop);
       nng_aio_wait(aiop);
       if ((xc = nng_aio_result(aiop))) {
-        nng_aio_free(aiop);
+        nano_sync_give(&nst->sync, aiop);
         goto fail;
       }
       msgp = nng_aio_get_msg(aiop);
-      nng_aio_free(aiop);
+      nano_sync_give(&nst->sync, aiop);
       buf = nng_msg_body(msgp);
       sz = nng_msg_len(msgp);
       res = nano_decode(buf, sz, mod, NANO_PROT(con));
       nng_msg_free(msgp);
     } else {
+      // reads into the arena of the Stream, decoding directly from it
       size_t xlen = nst->bufsize;
-      buf = malloc(xlen);
-      NANO_ENSURE_ALLOC(buf);
+      unsigned char *arena = nano_arena_take(nst->arena, &xlen);
+      if (arena == NULL) {
+        xlen = nst->bufsize;
+        buf = malloc(xlen);
+        NANO_ENSURE_ALLOC(buf);
+      }
       nng_iov iov = {
-        .iov_buf = buf,
+        .iov_buf = arena != NULL ? arena : buf,
         .iov_len = xlen
       };
       if ((xc = nng_aio_set_iov(aiop, 1u, &iov))) {
-        nng_aio_free(aiop);
+        nano_sync_give(&nst->sync, aiop);
+        if (arena != NULL)
+          nano_arena_give(nst->arena, 0);
         goto fail;
       }
       nng_aio_set_timeout(aiop, flags ? flags : (NANO_INTEGER(block) != 0) * NNG_DURATION_DEFAULT);
       nng_stream_recv(sp, aiop);
       nng_aio_wait(aiop);
-      if ((xc = nng_aio_result(aiop))) {
-        nng_aio_free(aiop);
-        goto fail;
-      }
+      xc = nng_aio_result(aiop);
       sz = nng_aio_count(aiop);
-      nng_aio_free(aiop);
-      res = nano_decode(buf, sz, mod, NANO_PROT(con));
-      free(buf);
+      nano_sync_give(&nst->sync, aiop);
+      if (arena != NULL) {
+        nano_adecode d = {nst->arena, arena, sz, mod, NANO_PROT(con)};
+        if (xc) {
+          nano_arena_cleanup(&d, FALSE);
+        } else {
+          res = R_UnwindProtect(nano_arena_decode, &d, nano_arena_cleanup, &d, NULL);
+        }
+      } else if (!xc) {
+        res = nano_decode(buf, sz, mod, NANO_PROT(con));
+        free(buf);
+      }
+      if (xc)
+        goto fail;
     }
 
   } else {
@@ -612,3 +1014,620 @@ SEXP rnng_recv(SEXP con, SEXP mode, SEXP block) {
   return mk_error(xc);
 
 }
+
+// receives a message from a Socket, Context, or websocket or framed Stream
+static int nano_recv_msg(SEXP con, const int flags, SEXP block, nng_msg **msgp) {
+
+  nng_aio *aiop = NULL;
+  int xc;
+
+  const int sock = !NANO_PTR_CHECK(con, nano_SocketSymbol);
+  if (sock || !NANO_PTR_CHECK(con, nano_ContextSymbol)) {
+
+    nano_sockctx *hd = (nano_sockctx *) NANO_PTR(con);
+    if (flags <= 0) {
+      const int fl = (flags < 0 || NANO_INTEGER(block) != 1) * NNG_FLAG_NONBLOCK;
+      return sock ? nng_recvmsg(hd->sock, msgp, fl) : nng_ctx_recvmsg(hd->ctx, msgp, fl);
+    }
+    if ((xc = nano_sync_take(&hd->sync, &aiop)))
+      return xc;
+    nng_aio_set_timeout(aiop, flags);
+    sock ? nng_recv_aio(hd->sock, aiop) : nng_ctx_recv(hd->ctx, aiop);
+    nng_aio_wait(aiop);
+    if (!(xc = nng_aio_result(aiop)))
+      *msgp = nng_aio_get_msg(aiop);
+    nano_sync_give(&hd->sync, aiop);
+    return xc;
+
+  }
+
+  nano_stream *nst = (nano_stream *) NANO_PTR(con);
+  const nng_duration dur = flags ? flags : (NANO_INTEGER(block) != 0) * NNG_DURATION_DEFAULT;
+
+  if (nst->frm != NULL) {
+    const int n = nano_frame_recv(nst, msgp, 1, dur);
+    return n < 0 ? -n : 0;
+  }
+  if ((xc = nano_sync_take(&nst->sync, &aiop)))
+    return xc;
+  nng_aio_set_timeout(aiop, dur);
+  nng_stream_recv(nst->stream, aiop);
+  nng_aio_wait(aiop);
+  if (!(xc = nng_aio_result(aiop)))
+    *msgp = nng_aio_get_msg(aiop);
+  nano_sync_give(&nst->sync, aiop);
+  return xc;
+
+}
+
+// reads up to len bytes from an unframed byte Stream straight into buf
+static int nano_stream_read(nano_stream *nst, unsigned char *buf, const size_t len, const nng_duration dur, size_t *sz) {
+
+  nng_aio *aiop = NULL;
+  int xc;
+  nng_iov iov = {
+    .iov_buf = buf,
+    .iov_len = len
+  };
+
+  if ((xc = nano_sync_take(&nst->sync, &aiop)))
+    return xc;
+  if (!(xc = nng_aio_set_iov(aiop, 1u, &iov))) {
+    nng_aio_set_timeout(aiop, dur);
+    nng_stream_recv(nst->stream, aiop);
+    nng_aio_wait(aiop);
+    xc = nng_aio_result(aiop);
+    *sz = nng_aio_count(aiop);
+  }
+  nano_sync_give(&nst->sync, aiop);
+  return xc;
+
+}
+
+static inline SEXP nano_bytes(const size_t sz) {
+
+  return sz <= INT_MAX ? Rf_ScalarInteger((int) sz) : Rf_ScalarReal((double) sz);
+
+}
+
+// the Stream of con if it is an unframed byte Stream, NULL if another
+// connection, or else an error
+static nano_stream *nano_byte_stream(SEXP con) {
+
+  if (!NANO_PTR_CHECK(con, nano_SocketSymbol) || !NANO_PTR_CHECK(con, nano_ContextSymbol))
+    return NULL;
+  if (NANO_PTR_CHECK(con, nano_StreamSymbol))
+    Rf_error("`con` is not a valid Socket, Context or Stream");
+  nano_stream *nst = (nano_stream *) NANO_PTR(con);
+  return nst->frm == NULL && !nst->msgmode ? nst : NULL;
+
+}
+
+SEXP rnng_recv_into(SEXP con, SEXP target, SEXP offset, SEXP block) {
+
+  size_t size;
+  switch (TYPEOF(target)) {
+  case RAWSXP: size = 1; break;
+  case INTSXP: size = sizeof(int); break;
+  case REALSXP: size = sizeof(double); break;
+  case CPLXSXP: size = 2 * sizeof(double); break;
+  default:
+    Rf_error("`target` must be a raw, integer, double or complex vector");
+  }
+  const double off = Rf_asReal(offset);
+  if (!(off >= 0 && off <= (double) XLENGTH(target)))
+    Rf_error("`offset` must be between 0 and the length of `target`");
+
+  const int flags = block == R_NilValue ? NNG_DURATION_DEFAULT : TYPEOF(block) == LGLSXP ? 0 : nano_integer(block);
+  nano_stream *nst = nano_byte_stream(con);
+  unsigned char *dst = (unsigned char *) NANO_DATAPTR(target) + (size_t) off * size;
+  const size_t space = (size_t) (XLENGTH(target) - (R_xlen_t) off) * size;
+  nng_msg *msgp = NULL;
+  size_t sz;
+  int xc;
+
+  if (nst != NULL) {
+    // reads straight into the target vector
+    if ((xc = nano_stream_read(nst, dst, space, flags ? flags : (NANO_INTEGER(block) != 0) * NNG_DURATION_DEFAULT, &sz)))
+      return mk_error(xc);
+    return nano_bytes(sz);
+  }
+
+  if ((xc = nano_recv_msg(con, flags, block, &msgp)))
+    return mk_error(xc);
+
+  sz = nng_msg_len(msgp);
+  if (sz > space) {
+    nng_msg_free(msgp);
+    return mk_error(NNG_EMSGSIZE);
+  }
+  if (sz)
+    memcpy(dst, nng_msg_body(msgp), sz);
+  nng_msg_free(msgp);
+
+  return nano_bytes(sz);
+
+}
+
+// file transfer ---------------------------------------------------------------
+
+#ifdef _WIN32
+#define NANO_FSEEK _fseeki64
+#define NANO_FTELL _ftelli64
+#else
+#define NANO_FSEEK fseeko
+#define NANO_FTELL ftello
+#endif
+#define NANO_ERRNO (errno ? NNG_ESYSERR + errno : NNG_EINTERNAL)
+
+// a region of a file, memory-mapped where supported or else read into memory
+typedef struct nano_fregion_s {
+  unsigned char *data;
+  void *base;
+  size_t len;
+  size_t maplen;
+} nano_fregion;
+
+static int nano_file_read(FILE *fp, const int64_t off, unsigned char *dst, const size_t len) {
+
+  errno = 0;
+  if (NANO_FSEEK(fp, off, SEEK_SET))
+    return NANO_ERRNO;
+  size_t cur = 0, n;
+  while (cur < len) {
+    if ((n = fread(dst + cur, 1, len - cur, fp)) == 0)
+      return NANO_ERRNO;
+    cur += n;
+  }
+  return 0;
+
+}
+
+static int nano_fregion_load(FILE *fp, const int64_t off, const size_t len, nano_fregion *r) {
+
+  int xc;
+  r->data = NULL;
+  r->base = NULL;
+  r->len = len;
+  r->maplen = 0;
+  if (len == 0)
+    return 0;
+
+#ifndef _WIN32
+  const int64_t page = (int64_t) sysconf(_SC_PAGESIZE);
+  const int64_t start = off - off % page;
+  void *base = mmap(NULL, len + (size_t) (off - start), PROT_READ, MAP_PRIVATE, fileno(fp), (off_t) start);
+  if (base != MAP_FAILED) {
+    r->base = base;
+    r->maplen = len + (size_t) (off - start);
+    r->data = (unsigned char *) base + (off - start);
+    return 0;
+  }
+#endif
+
+  if ((r->data = malloc(len)) == NULL)
+    return NNG_ENOMEM;
+  if ((xc = nano_file_read(fp, off, r->data, len))) {
+    free(r->data);
+    r->data = NULL;
+  }
+  return xc;
+
+}
+
+static void nano_fregion_free(nano_fregion *r) {
+
+#ifndef _WIN32
+  if (r->base != NULL) {
+    munmap(r->base, r->maplen);
+    return;
+  }
+#endif
+  free(r->data);
+
+}
+
+static int nano_file_write(FILE *fp, const unsigned char *src, const size_t len) {
+
+  errno = 0;
+  return len && fwrite(src, 1, len, fp) != len ? NANO_ERRNO : 0;
+
+}
+
+// opens a temporary file alongside 'file', to be renamed over it once complete
+static FILE *nano_file_temp(const char *file, char **tmp) {
+
+  const size_t n = strlen(file);
+  char *p = R_alloc(n + 8, sizeof(char));
+  memcpy(p, file, n);
+  memcpy(p + n, ".XXXXXX", 8);
+  *tmp = p;
+
+#ifdef _WIN32
+  return _mktemp_s(p, n + 8) ? NULL : fopen(p, "wb");
+#else
+  const int fd = mkstemp(p);
+  if (fd < 0)
+    return NULL;
+  // as created by fopen(), rather than the owner-only mode of mkstemp()
+  const mode_t mask = umask(0);
+  umask(mask);
+  fchmod(fd, 0666 & ~mask);
+  FILE *fp = fdopen(fd, "wb");
+  if (fp == NULL) {
+    close(fd);
+    remove(p);
+  }
+  return fp;
+#endif
+
+}
+
+static int nano_file_commit(const char *tmp, const char *file) {
+
+#ifdef _WIN32
+  // rename() does not replace an existing file on Windows, so the file is
+  // moved over it in a single step
+  const int ntmp = MultiByteToWideChar(CP_ACP, 0, tmp, -1, NULL, 0);
+  const int nfile = MultiByteToWideChar(CP_ACP, 0, file, -1, NULL, 0);
+  if (!ntmp || !nfile)
+    return NNG_ESYSERR + (int) GetLastError();
+  wchar_t *wtmp = (wchar_t *) R_alloc((size_t) ntmp, sizeof(wchar_t));
+  wchar_t *wfile = (wchar_t *) R_alloc((size_t) nfile, sizeof(wchar_t));
+  MultiByteToWideChar(CP_ACP, 0, tmp, -1, wtmp, ntmp);
+  MultiByteToWideChar(CP_ACP, 0, file, -1, wfile, nfile);
+  return MoveFileExW(wtmp, wfile, MOVEFILE_REPLACE_EXISTING) ? 0 : NNG_ESYSERR + (int) GetLastError();
+#else
+  errno = 0;
+  return rename(tmp, file) ? NANO_ERRNO : 0;
+#endif
+
+}
+
+static const char *nano_file_path(SEXP path) {
+
+  if (TYPEOF(path) != STRSXP || XLENGTH(path) != 1)
+    Rf_error("`path` must be a character string");
+  return R_ExpandFileName(CHAR(STRING_ELT(path, 0)));
+
+}
+
+SEXP rnng_send_file(SEXP con, SEXP path, SEXP offset, SEXP length, SEXP block) {
+
+  const int flags = block == R_NilValue ? NNG_DURATION_DEFAULT : TYPEOF(block) == LGLSXP ? 0 : nano_integer(block);
+  const int sock = !NANO_PTR_CHECK(con, nano_SocketSymbol);
+  const int stream = !sock && NANO_PTR_CHECK(con, nano_ContextSymbol);
+  if (stream && NANO_PTR_CHECK(con, nano_StreamSymbol))
+    Rf_error("`con` is not a valid Socket, Context or Stream");
+
+  const char *file = nano_file_path(path);
+  FILE *fp = fopen(file, "rb");
+  if (fp == NULL)
+    Rf_error("file '%s' could not be opened", file);
+  if (NANO_FSEEK(fp, 0, SEEK_END)) {
+    fclose(fp);
+    Rf_error("file '%s' could not be read", file);
+  }
+  const double fsize = (double) NANO_FTELL(fp);
+  const double off = Rf_asReal(offset);
+  const double len = length == R_NilValue ? fsize - off : Rf_asReal(length);
+  if (!(off >= 0 && len >= 0 && off + len <= fsize)) {
+    fclose(fp);
+    Rf_error("`offset` and `length` must lie within the file");
+  }
+
+  nng_msg *msgp = NULL;
+  nng_aio *aiop = NULL;
+  int xc;
+
+  if (!stream) {
+
+    // read straight into the body of the message
+    nano_sockctx *hd = (nano_sockctx *) NANO_PTR(con);
+    if ((xc = nng_msg_alloc(&msgp, (size_t) len)))
+      goto fail;
+    if ((xc = nano_file_read(fp, (int64_t) off, nng_msg_body(msgp), (size_t) len))) {
+      nng_msg_free(msgp);
+      goto fail;
+    }
+    fclose(fp);
+
+    if (flags <= 0) {
+      const int fl = flags ? NNG_FLAG_NONBLOCK : (NANO_INTEGER(block) != 1) * NNG_FLAG_NONBLOCK;
+      if ((xc = sock ? nng_sendmsg(hd->sock, msgp, fl) : nng_ctx_sendmsg(hd->ctx, msgp, fl)))
+        nng_msg_free(msgp);
+    } else {
+      if ((xc = nano_sync_take(&hd->sync, &aiop))) {
+        nng_msg_free(msgp);
+        return mk_error(xc);
+      }
+      nng_aio_set_msg(aiop, msgp);
+      nng_aio_set_timeout(aiop, flags);
+      sock ? nng_send_aio(hd->sock, aiop) : nng_ctx_send(hd->ctx, aiop);
+      nng_aio_wait(aiop);
+      if ((xc = nng_aio_result(aiop)))
+        nng_msg_free(nng_aio_get_msg(aiop));
+      nano_sync_give(&hd->sync, aiop);
+    }
+
+  } else {
+
+    nano_stream *nst = (nano_stream *) NANO_PTR(con);
+    nano_framer *f = nst->frm;
+    nano_fregion r;
+    if (f != NULL && (xc = nano_frame_check(f, (size_t) len)))
+      goto fail;
+    xc = nano_fregion_load(fp, (int64_t) off, (size_t) len, &r);
+    fclose(fp);
+    if (xc)
+      return mk_error(xc);
+
+    if ((xc = nano_sync_take(&nst->sync, &aiop))) {
+      nano_fregion_free(&r);
+      return mk_error(xc);
+    }
+
+    if (nst->msgmode) {
+      if (!(xc = nng_msg_alloc(&msgp, r.len))) {
+        if (r.len)
+          memcpy(nng_msg_body(msgp), r.data, r.len);
+        nng_aio_set_msg(aiop, msgp);
+      }
+    } else {
+      // written out from the mapped file, with any framing either side
+      unsigned char hdr[8];
+      nng_iov iov[3];
+      unsigned n = 0;
+      if (f != NULL && NANO_FRAME_PREFIXED(f)) {
+        iov[n].iov_buf = hdr;
+        iov[n++].iov_len = nano_frame_header(f, hdr, r.len);
+      }
+      iov[n].iov_buf = r.data;
+      iov[n++].iov_len = r.len;
+      if (f != NULL && !NANO_FRAME_PREFIXED(f) && nano_frame_overhead(f)) {
+        iov[n].iov_buf = hdr;
+        iov[n++].iov_len = nano_frame_header(f, hdr, r.len);
+      }
+      xc = nng_aio_set_iov(aiop, n, iov);
+    }
+
+    if (!xc) {
+      nng_aio_set_timeout(aiop, flags ? flags : (NANO_INTEGER(block) != 0) * NNG_DURATION_DEFAULT);
+      nng_stream_send(nst->stream, aiop);
+      nng_aio_wait(aiop);
+      if ((xc = nng_aio_result(aiop)) && nst->msgmode)
+        nng_msg_free(nng_aio_get_msg(aiop));
+    }
+    nano_sync_give(&nst->sync, aiop);
+    nano_fregion_free(&r);
+
+  }
+
+  return xc ? mk_error(xc) : nano_success;
+
+  fail:
+  fclose(fp);
+  return mk_error(xc);
+
+}
+
+SEXP rnng_recv_file(SEXP con, SEXP path, SEXP length, SEXP block) {
+
+  const int flags = block == R_NilValue ? NNG_DURATION_DEFAULT : TYPEOF(block) == LGLSXP ? 0 : nano_integer(block);
+  nano_stream *nst = nano_byte_stream(con);
+  double want = 0;
+  if (nst != NULL) {
+    if (length == R_NilValue)
+      Rf_error("`length` must be specified for a Stream without framing");
+    want = Rf_asReal(length);
+    if (!(want >= 0))
+      Rf_error("`length` must be a non-negative number");
+  }
+
+  const char *file = nano_file_path(path);
+  char *tmp;
+  FILE *fp = nano_file_temp(file, &tmp);
+  if (fp == NULL)
+    Rf_error("file '%s' could not be opened for writing", file);
+
+  nng_msg *msgp = NULL;
+  size_t total = 0;
+  int xc;
+
+  if (nst == NULL) {
+
+    if (!(xc = nano_recv_msg(con, flags, block, &msgp))) {
+      total = nng_msg_len(msgp);
+      xc = nano_file_write(fp, nng_msg_body(msgp), total);
+      nng_msg_free(msgp);
+    }
+
+  } else {
+
+    // reads through the arena of the Stream, writing out each read
+    const nng_duration dur = flags ? flags : (NANO_INTEGER(block) != 0) * NNG_DURATION_DEFAULT;
+    const size_t len = (size_t) want;
+    unsigned char *buf = NULL;
+    xc = 0;
+    while (total < len && !xc) {
+      size_t cap = nst->bufsize, sz = 0;
+      unsigned char *arena = nano_arena_take(nst->arena, &cap);
+      if (arena == NULL && buf == NULL && (buf = malloc(nst->bufsize)) == NULL) {
+        xc = NNG_ENOMEM;
+        break;
+      }
+      if (cap > len - total)
+        cap = len - total;
+      if (!(xc = nano_stream_read(nst, arena != NULL ? arena : buf, cap, dur, &sz)))
+        xc = nano_file_write(fp, arena != NULL ? arena : buf, sz);
+      if (arena != NULL)
+        nano_arena_give(nst->arena, sz);
+      total += sz;
+    }
+    free(buf);
+
+  }
+
+  if (fclose(fp) && !xc)
+    xc = NANO_ERRNO;
+  // any existing file is replaced only by a complete receive
+  if (!xc)
+    xc = nano_file_commit(tmp, file);
+  if (xc)
+    remove(tmp);
+
+  return xc ? mk_error(xc) : nano_bytes(total);
+
+}
+
+typedef struct nano_rbatch_s {
+  nng_msg **msgs;
+  int count;
+  int done;
+  uint8_t mod;
+  SEXP con;
+} nano_rbatch;
+
+// Builds the result of recv_batch(), freeing each message once converted.
+// Run under R_UnwindProtect so that messages not yet converted are freed if
+// an allocation or decode error jumps out.
+static SEXP nano_rbatch_build(void *data) {
+
+  nano_rbatch *b = (nano_rbatch *) data;
+  nng_msg **msgs = b->msgs;
+  SEXP out;
+
+  // fixed-width modes are returned as one vector, if every message converts
+  SEXPTYPE typ = NILSXP;
+  size_t size = 0;
+  switch (b->mod) {
+  case 3: typ = CPLXSXP; size = 2 * sizeof(double); break;
+  case 4:
+  case 7: typ = REALSXP; size = sizeof(double); break;
+  case 5: typ = INTSXP; size = sizeof(int); break;
+  case 6: typ = LGLSXP; size = sizeof(int); break;
+  case 8: typ = RAWSXP; size = 1; break;
+  }
+  size_t total = 0;
+  for (int i = 0; size && i < b->count; i++) {
+    const size_t len = nng_msg_len(msgs[i]);
+    if (len % size) size = 0;
+    total += len;
+  }
+
+  if (size) {
+    SEXP offsets;
+    const R_xlen_t xlen = (R_xlen_t) (total / size);
+    PROTECT(out = Rf_allocVector(typ, xlen));
+    PROTECT(offsets = Rf_allocVector(REALSXP, b->count + 1));
+    unsigned char *p = (unsigned char *) NANO_DATAPTR(out);
+    double *off = REAL(offsets);
+    R_xlen_t cur = 0;
+    for (int i = 0; i < b->count; i++) {
+      const size_t len = nng_msg_len(msgs[i]);
+      if (len) memcpy(p, nng_msg_body(msgs[i]), len);
+      p += len;
+      off[i] = (double) cur;
+      cur += (R_xlen_t) (len / size);
+      nng_msg_free(msgs[i]);
+      b->done++;
+    }
+    off[b->count] = (double) cur;
+    if (cur <= INT_MAX)
+      offsets = Rf_coerceVector(offsets, INTSXP);
+    Rf_setAttrib(out, nano_OffsetsSymbol, offsets);
+    UNPROTECT(2);
+  } else {
+    PROTECT(out = Rf_allocVector(VECSXP, b->count));
+    for (int i = 0; i < b->count; i++) {
+      SET_VECTOR_ELT(out, i, nano_decode(nng_msg_body(msgs[i]), nng_msg_len(msgs[i]), b->mod, NANO_PROT(b->con)));
+      nng_msg_free(msgs[i]);
+      b->done++;
+    }
+    UNPROTECT(1);
+  }
+
+  return out;
+
+}
+
+static void nano_rbatch_cleanup(void *data, Rboolean jump) {
+
+  if (jump) {
+    nano_rbatch *b = (nano_rbatch *) data;
+    for (int i = b->done; i < b->count; i++)
+      nng_msg_free(b->msgs[i]);
+  }
+
+}
+
+SEXP rnng_recv_batch(SEXP con, SEXP max_n, SEXP mode, SEXP timeout) {
+
+  const int rcv = !NANO_PTR_CHECK(con, nano_ReceiverSymbol);
+  const int sock = !rcv && !NANO_PTR_CHECK(con, nano_SocketSymbol);
+  const int frm = !rcv && !sock && !NANO_PTR_CHECK(con, nano_StreamSymbol) &&
+    ((nano_stream *) NANO_PTR(con))->frm != NULL;
+  if (!rcv && !sock && !frm && NANO_PTR_CHECK(con, nano_ContextSymbol))
+    Rf_error("`con` is not a valid Socket, Context, Receiver or framed Stream");
+
+  const int n = nano_integer(max_n);
+  if (n < 1)
+    Rf_error("`max_n` must be a positive integer");
+  const nng_duration dur = timeout == R_NilValue ? NNG_DURATION_DEFAULT : (nng_duration) nano_integer(timeout);
+  uint8_t mod = nano_matcharg(mode);
+  if (frm && mod == 1)
+    mod = 2;
+  nng_aio *aiop = NULL;
+  int count = 0, xc;
+
+  nng_msg **msgs = (nng_msg **) R_alloc(n, sizeof(nng_msg *));
+
+  if (rcv) {
+    // take from the ring buffer of a background receiver
+    if ((count = nano_receiver_take(con, msgs, n, dur)) < 0) {
+      xc = -count;
+      goto fail;
+    }
+  } else if (frm) {
+    // wait for the first frame, then take those already buffered
+    if ((count = nano_frame_recv((nano_stream *) NANO_PTR(con), msgs, n, dur)) < 0) {
+      xc = -count;
+      goto fail;
+    }
+  } else {
+    // wait for the first message, then drain those already queued
+    if (dur == 0) {
+      if ((xc = sock ? nng_recvmsg(*(nng_socket *) NANO_PTR(con), &msgs[0], NNG_FLAG_NONBLOCK) :
+                       nng_ctx_recvmsg(*(nng_ctx *) NANO_PTR(con), &msgs[0], NNG_FLAG_NONBLOCK)))
+        goto fail;
+    } else {
+      nano_sockctx *hd = (nano_sockctx *) NANO_PTR(con);
+      if ((xc = nano_sync_take(&hd->sync, &aiop)))
+        goto fail;
+      nng_aio_set_timeout(aiop, dur);
+      sock ? nng_recv_aio(hd->sock, aiop) : nng_ctx_recv(hd->ctx, aiop);
+      nng_aio_wait(aiop);
+      if ((xc = nng_aio_result(aiop))) {
+        nano_sync_give(&hd->sync, aiop);
+        goto fail;
+      }
+      msgs[0] = nng_aio_get_msg(aiop);
+      nano_sync_give(&hd->sync, aiop);
+    }
+    count = 1;
+
+    while (count < n) {
+      if (sock ? nng_recvmsg(*(nng_socket *) NANO_PTR(con), &msgs[count], NNG_FLAG_NONBLOCK) :
+                 nng_ctx_recvmsg(*(nng_ctx *) NANO_PTR(con), &msgs[count], NNG_FLAG_NONBLOCK))
+        break;
+      count++;
+    }
+  }
+
+  nano_rbatch batch = {msgs, count, 0, mod, con};
+  return R_UnwindProtect(nano_rbatch_build, &batch, nano_rbatch_cleanup, &batch, NULL);
+
+  fail:
+  return mk_error(xc);
+
+}
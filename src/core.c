@@ -64,6 +64,764 @@ static int nano_read_char(R_inpstream_t stream) {
 
 }
 
+// serialization hook class matching -----------------------------------------
+
+// Objects of the same class share equal class attributes, whose elements are
+// cached CHARSXPs, so matches against the configured hook classes are cached
+// per serialization by comparing pointers rather than strings. The cached class
+// vectors are held in a protected list, as temporaries (such as ALTREP states)
+// may otherwise be collected and their addresses reused mid-serialization.
+
+static int nano_hook_klass_equal(const SEXP a, const SEXP b) {
+
+  if (a == b)
+    return 1;
+  const R_xlen_t xlen = XLENGTH(a);
+  if (XLENGTH(b) != xlen)
+    return 0;
+  const SEXP *a_p = STRING_PTR_RO(a), *b_p = STRING_PTR_RO(b);
+  for (R_xlen_t i = 0; i < xlen; i++)
+    if (a_p[i] != b_p[i]) return 0;
+
+  return 1;
+
+}
+
+// Returns the index of the matching hook class, or -1 if there is none.
+static int nano_hook_match(const SEXP x) {
+
+  if (!Rf_isObject(x))
+    return -1;
+
+  const SEXP xklass = Rf_getAttrib(x, R_ClassSymbol);
+  const int cached = TYPEOF(xklass) == STRSXP;
+  if (cached) {
+    for (int j = 0; j < nano_bundle.cache_n; j++)
+      if (nano_hook_klass_equal(VECTOR_ELT(nano_bundle.cache, j), xklass))
+        return nano_bundle.cache_match[j];
+  }
+
+  const SEXP klass = nano_bundle.klass;
+  const int len = (int) XLENGTH(klass);
+  const SEXP *klass_p = STRING_PTR_RO(klass);
+  int match = -1;
+  for (int i = 0; i < len; i++) {
+    if (Rf_inherits(x, CHAR(klass_p[i]))) {
+      match = i;
+      break;
+    }
+  }
+
+  if (cached) {
+    const int j = nano_bundle.cache_n < NANO_HOOK_CACHE ? nano_bundle.cache_n++ : NANO_HOOK_CACHE - 1;
+    SET_VECTOR_ELT(nano_bundle.cache, j, xklass);
+    nano_bundle.cache_match[j] = match;
+  }
+
+  return match;
+
+}
+
+// Returns an attribute as stored, without the expansion of compact row names
+// c(NA, -n) into 1:n performed by Rf_getAttrib().
+static SEXP nano_attrib_raw(const SEXP x, const SEXP sym) {
+
+  for (SEXP a = ATTRIB(x); a != R_NilValue; a = CDR(a))
+    if (TAG(a) == sym) return CAR(a);
+
+  return R_NilValue;
+
+}
+
+// serialized size estimation ------------------------------------------------
+
+// Upper estimate of the R serialization (binary, version 3) of an object, used
+// to size the output buffer in one allocation. Returns 0 where no reasonable
+// estimate can be made (environments, closures, language objects, external
+// pointers, S4 objects and ALTREP character vectors and lists, whose expanded
+// size is unknown without materialising them), in which case the buffer is
+// grown on demand as before. Other ALTREP vectors are bounded by their
+// expanded length, plus the class information if written in compact form. A
+// low estimate is safe as nano_write_bytes() still grows the buffer if required.
+
+#define NANO_SERIAL_HDR 96
+#define NANO_SERIAL_ATTR 40
+#define NANO_SERIAL_ALTREP 128
+
+static size_t nano_serial_size(const SEXP x);
+
+static size_t nano_serial_size_strs(const SEXP x) {
+
+  const R_xlen_t xlen = XLENGTH(x);
+  const SEXP *x_p = STRING_PTR_RO(x);
+  size_t sz = 2 * sizeof(int) * (size_t) xlen;
+  for (R_xlen_t i = 0; i < xlen; i++)
+    if (x_p[i] != NA_STRING) sz += LENGTH(x_p[i]);
+
+  return sz;
+
+}
+
+static size_t nano_serial_size_attr(const SEXP x, const SEXP sym) {
+
+  const SEXP attr = nano_attrib_raw(x, sym);
+  if (attr == R_NilValue)
+    return 0;
+  const size_t sz = nano_serial_size(attr);
+
+  return sz ? NANO_SERIAL_ATTR + sz : SIZE_MAX;
+
+}
+
+static size_t nano_serial_size(const SEXP x) {
+
+  size_t sz;
+  const SEXPTYPE typ = TYPEOF(x);
+  R_CheckStack();
+
+  switch (typ) {
+  case NILSXP:
+    return sizeof(int);
+  case SYMSXP:
+    return 3 * sizeof(int) + strlen(CHAR(PRINTNAME(x)));
+  case CHARSXP:
+    return 2 * sizeof(int) + (x == NA_STRING ? 0 : LENGTH(x));
+  case LGLSXP:
+  case INTSXP:
+  case REALSXP:
+  case CPLXSXP:
+  case RAWSXP:
+  case STRSXP:
+  case VECSXP:
+    break;
+  default:
+    return 0;
+  }
+
+  if (Rf_isS4(x) || (ALTREP(x) && (typ == STRSXP || typ == VECSXP)))
+    return 0;
+
+  const R_xlen_t xlen = XLENGTH(x);
+  sz = (xlen > INT_MAX ? 4 : 2) * sizeof(int);
+  if (ALTREP(x))
+    sz += NANO_SERIAL_ALTREP;
+
+  switch (typ) {
+  case LGLSXP:
+  case INTSXP:
+    sz += xlen * sizeof(int);
+    break;
+  case REALSXP:
+    sz += xlen * sizeof(double);
+    break;
+  case CPLXSXP:
+    sz += xlen * 2 * sizeof(double);
+    break;
+  case RAWSXP:
+    sz += xlen;
+    break;
+  case STRSXP:
+    sz += nano_serial_size_strs(x);
+    break;
+  case VECSXP: {
+    const SEXP *x_p = VECTOR_PTR_RO(x);
+    for (R_xlen_t i = 0; i < xlen; i++) {
+      const size_t isz = nano_serial_size(x_p[i]);
+      if (isz == 0) return 0;
+      sz += isz;
+    }
+    break;
+  }
+  }
+
+  // attributes other than those below are not seen, but are usually small
+  const SEXP syms[] = {R_NamesSymbol, R_DimSymbol, R_DimNamesSymbol, R_ClassSymbol, R_LevelsSymbol, R_RowNamesSymbol};
+  size_t asz = 0;
+  for (size_t i = 0; i < sizeof(syms) / sizeof(SEXP); i++) {
+    const size_t isz = nano_serial_size_attr(x, syms[i]);
+    if (isz == SIZE_MAX) return 0;
+    asz += isz;
+  }
+  if (asz)
+    sz += asz + sizeof(int);
+
+  return sz;
+
+}
+
+// typed framing ---------------------------------------------------------------
+
+// Each item is a 16 byte header (uint8 SEXPTYPE, uint8 flags, uint16 unused,
+// uint32 ndim, uint64 length), followed by int32 dims and then, per flag bit:
+// 0 names, 1 class, 2 levels (each a string block, the latter two prefixed by
+// a uint64 count), 3 row names (a nested item), and finally the data. Bit 4
+// marks dictionary-encoded character data: a uint64 count, the string block of
+// unique values, then int32 codes. Blocks are zero-padded to 8 byte boundaries
+// so numeric columns are contiguous and aligned. Strings are written as a
+// uint32 byte count (UINT32_MAX for NA) plus UTF-8 bytes.
+
+#define NANO_TYPED_NAMES 0x1
+#define NANO_TYPED_CLASS 0x2
+#define NANO_TYPED_LEVELS 0x4
+#define NANO_TYPED_ROWNAMES 0x8
+#define NANO_TYPED_DICT 0x10
+#define NANO_TYPED_DICT_MIN 16
+
+typedef struct nano_typed_dict_s {
+  struct nano_typed_dict_s *next;
+  SEXP x;
+  SEXP *uniq;
+  int *codes;
+  R_xlen_t n;
+} nano_typed_dict;
+
+typedef struct nano_typed_ctx_s {
+  nano_typed_dict *head;
+  nano_typed_dict *tail;
+} nano_typed_ctx;
+
+static const unsigned char nano_typed_magic[4] = {0x4e, 0x54, 0x59, 0x01};
+static const uint32_t nano_typed_bom = 0x01020304;
+
+static size_t nano_typed_strsize(const SEXP *x_p, const R_xlen_t xlen) {
+
+  size_t sz = 0;
+  const void *vmax = vmaxget();
+  for (R_xlen_t i = 0; i < xlen; i++) {
+    sz += sizeof(uint32_t) + (x_p[i] == NA_STRING ? 0 : strlen(Rf_translateCharUTF8(x_p[i])));
+    vmaxset(vmax);
+  }
+
+  return NANO_ALIGN8(sz);
+
+}
+
+// Maps each element to an index into its unique values, using the fact that
+// equal strings share a cached CHARSXP. Gives up (returning NULL) once more
+// than half the elements are distinct. Allocations are transient (R_alloc).
+static nano_typed_dict *nano_typed_dict_build(const SEXP x) {
+
+  const R_xlen_t xlen = XLENGTH(x);
+  if (xlen < NANO_TYPED_DICT_MIN)
+    return NULL;
+
+  const SEXP *x_p = STRING_PTR_RO(x);
+  const R_xlen_t limit = xlen / 2;
+  size_t cap = 64;
+  while (cap < (size_t) xlen * 2) cap <<= 1;
+  const size_t mask = cap - 1;
+
+  SEXP *keys = (SEXP *) R_alloc(cap, sizeof(SEXP));
+  int *vals = (int *) R_alloc(cap, sizeof(int));
+  SEXP *uniq = (SEXP *) R_alloc(limit, sizeof(SEXP));
+  int *codes = (int *) R_alloc(xlen, sizeof(int));
+  memset(keys, 0, cap * sizeof(SEXP));
+  R_xlen_t n = 0;
+
+  for (R_xlen_t i = 0; i < xlen; i++) {
+    const SEXP s = x_p[i];
+    if (s == NA_STRING) {
+      codes[i] = NA_INTEGER;
+      continue;
+    }
+    size_t h = (size_t) ((((uint64_t) (uintptr_t) s >> 3) * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+    while (keys[h] != NULL && keys[h] != s)
+      h = (h + 1) & mask;
+    if (keys[h] == NULL) {
+      if (n == limit)
+        return NULL;
+      keys[h] = s;
+      vals[h] = (int) n;
+      uniq[n++] = s;
+    }
+    codes[i] = vals[h];
+  }
+
+  nano_typed_dict *dict = (nano_typed_dict *) R_alloc(1, sizeof(nano_typed_dict));
+  dict->next = NULL;
+  dict->x = x;
+  dict->uniq = uniq;
+  dict->codes = codes;
+  dict->n = n;
+  return dict;
+
+}
+
+static int nano_typed_is_factor(const SEXP x) {
+
+  return Rf_isFactor(x) && TYPEOF(Rf_getAttrib(x, R_LevelsSymbol)) == STRSXP;
+
+}
+
+// Row names 1:n are sent in R's compact form c(NA, -n). Takes the attribute as
+// stored (nano_attrib_raw) and returns n, or 0 if the row names are not 1:n.
+static int nano_typed_rownames_compact(const SEXP rn) {
+
+  if (TYPEOF(rn) != INTSXP || XLENGTH(rn) == 0)
+    return 0;
+  const int *rn_p = INTEGER_RO(rn);
+  const R_xlen_t xlen = XLENGTH(rn);
+  if (xlen == 2 && rn_p[0] == NA_INTEGER)
+    return rn_p[1] == NA_INTEGER ? 0 : abs(rn_p[1]);
+  for (R_xlen_t i = 0; i < xlen; i++)
+    if (rn_p[i] != i + 1) return 0;
+
+  return (int) xlen;
+
+}
+
+static size_t nano_typed_size(const SEXP x, nano_typed_ctx *ctx) {
+
+  const R_xlen_t xlen = Rf_xlength(x);
+  size_t sz = 16;
+
+  switch (TYPEOF(x)) {
+  case NILSXP:
+    return sz;
+  case LGLSXP:
+    sz += NANO_ALIGN8(xlen * sizeof(int));
+    break;
+  case INTSXP:
+    sz += NANO_ALIGN8(xlen * sizeof(int));
+    if (nano_typed_is_factor(x)) {
+      const SEXP levels = Rf_getAttrib(x, R_LevelsSymbol);
+      const SEXP klass = Rf_getAttrib(x, R_ClassSymbol);
+      sz += 16 + nano_typed_strsize(STRING_PTR_RO(levels), XLENGTH(levels)) +
+        nano_typed_strsize(STRING_PTR_RO(klass), XLENGTH(klass));
+    }
+    break;
+  case REALSXP:
+    sz += xlen * sizeof(double);
+    break;
+  case CPLXSXP:
+    sz += xlen * 2 * sizeof(double);
+    break;
+  case RAWSXP:
+    sz += NANO_ALIGN8(xlen);
+    break;
+  case STRSXP: {
+    const size_t plain = nano_typed_strsize(STRING_PTR_RO(x), xlen);
+    nano_typed_dict *dict = nano_typed_dict_build(x);
+    size_t dsz;
+    if (dict != NULL && (dsz = 8 + nano_typed_strsize(dict->uniq, dict->n) + NANO_ALIGN8(xlen * sizeof(int))) < plain) {
+      if (ctx->tail == NULL) ctx->head = dict; else ctx->tail->next = dict;
+      ctx->tail = dict;
+      sz += dsz;
+    } else {
+      sz += plain;
+    }
+    break;
+  }
+  case VECSXP: {
+    if (Rf_inherits(x, "data.frame")) {
+      const SEXP klass = Rf_getAttrib(x, R_ClassSymbol);
+      const SEXP rn = nano_attrib_raw(x, R_RowNamesSymbol);
+      sz += 8 + nano_typed_strsize(STRING_PTR_RO(klass), XLENGTH(klass));
+      sz += nano_typed_rownames_compact(rn) ? 16 + 2 * sizeof(int) : nano_typed_size(rn, ctx);
+    }
+    const SEXP *x_p = VECTOR_PTR_RO(x);
+    for (R_xlen_t i = 0; i < xlen; i++)
+      sz += nano_typed_size(x_p[i], ctx);
+    break;
+  }
+  default:
+    Rf_error("`data` must be an atomic vector or list of atomic vectors to send in mode 'typed'");
+  }
+
+  const SEXP dim = Rf_getAttrib(x, R_DimSymbol);
+  if (dim != R_NilValue)
+    sz += NANO_ALIGN8(XLENGTH(dim) * sizeof(int));
+  const SEXP names = Rf_getAttrib(x, R_NamesSymbol);
+  if (names != R_NilValue)
+    sz += nano_typed_strsize(STRING_PTR_RO(names), XLENGTH(names));
+
+  return sz;
+
+}
+
+static unsigned char *nano_typed_copy(unsigned char *p, const void *src, const size_t sz) {
+
+  const size_t asz = NANO_ALIGN8(sz);
+  if (sz)
+    memcpy(p, src, sz);
+  if (asz > sz)
+    memset(p + sz, 0, asz - sz);
+  return p + asz;
+
+}
+
+static unsigned char *nano_typed_write_str(unsigned char *p, const SEXP *x_p, const R_xlen_t xlen) {
+
+  unsigned char *start = p;
+  const void *vmax = vmaxget();
+  for (R_xlen_t i = 0; i < xlen; i++) {
+    uint32_t slen = UINT32_MAX;
+    if (x_p[i] != NA_STRING) {
+      const char *s = Rf_translateCharUTF8(x_p[i]);
+      slen = (uint32_t) strlen(s);
+      memcpy(p + sizeof(uint32_t), s, slen);
+      vmaxset(vmax);
+    }
+    memcpy(p, &slen, sizeof(uint32_t));
+    p += sizeof(uint32_t) + (slen == UINT32_MAX ? 0 : slen);
+  }
+
+  const size_t sz = (size_t) (p - start), asz = NANO_ALIGN8(sz);
+  memset(p, 0, asz - sz);
+  return start + asz;
+
+}
+
+static unsigned char *nano_typed_write_strs(unsigned char *p, const SEXP x) {
+
+  const uint64_t n = (uint64_t) XLENGTH(x);
+  memcpy(p, &n, sizeof(uint64_t));
+  return nano_typed_write_str(p + sizeof(uint64_t), STRING_PTR_RO(x), (R_xlen_t) n);
+
+}
+
+static unsigned char *nano_typed_write_header(unsigned char *p, const SEXPTYPE typ, const uint8_t flags,
+                                              const uint32_t ndim, const uint64_t xlen) {
+
+  memset(p, 0, 16);
+  p[0] = (unsigned char) typ;
+  p[1] = flags;
+  memcpy(p + 4, &ndim, sizeof(uint32_t));
+  memcpy(p + 8, &xlen, sizeof(uint64_t));
+  return p + 16;
+
+}
+
+static unsigned char *nano_typed_write(unsigned char *p, const SEXP x, nano_typed_ctx *ctx) {
+
+  const SEXPTYPE typ = TYPEOF(x);
+  const SEXP dim = Rf_getAttrib(x, R_DimSymbol);
+  const SEXP names = typ == NILSXP ? R_NilValue : Rf_getAttrib(x, R_NamesSymbol);
+  const int frame = typ == VECSXP && Rf_inherits(x, "data.frame");
+  const int factor = nano_typed_is_factor(x);
+  nano_typed_dict *dict = NULL;
+  if (typ == STRSXP && ctx->head != NULL && ctx->head->x == x) {
+    dict = ctx->head;
+    ctx->head = dict->next;
+  }
+  const uint64_t xlen = (uint64_t) Rf_xlength(x);
+  const uint32_t ndim = dim == R_NilValue ? 0 : (uint32_t) XLENGTH(dim);
+  const uint8_t flags = (names != R_NilValue ? NANO_TYPED_NAMES : 0) |
+    (frame || factor ? NANO_TYPED_CLASS : 0) | (factor ? NANO_TYPED_LEVELS : 0) |
+    (frame ? NANO_TYPED_ROWNAMES : 0) | (dict != NULL ? NANO_TYPED_DICT : 0);
+
+  p = nano_typed_write_header(p, typ, flags, ndim, xlen);
+
+  if (ndim)
+    p = nano_typed_copy(p, DATAPTR_RO(dim), ndim * sizeof(int));
+  if (names != R_NilValue)
+    p = nano_typed_write_str(p, STRING_PTR_RO(names), XLENGTH(names));
+  if (flags & NANO_TYPED_CLASS)
+    p = nano_typed_write_strs(p, Rf_getAttrib(x, R_ClassSymbol));
+  if (factor)
+    p = nano_typed_write_strs(p, Rf_getAttrib(x, R_LevelsSymbol));
+  if (frame) {
+    const SEXP rn = nano_attrib_raw(x, R_RowNamesSymbol);
+    const int nrow = nano_typed_rownames_compact(rn);
+    if (nrow) {
+      const int compact[2] = {NA_INTEGER, -nrow};
+      p = nano_typed_write_header(p, INTSXP, 0, 0, 2);
+      p = nano_typed_copy(p, compact, sizeof(compact));
+    } else {
+      p = nano_typed_write(p, rn, ctx);
+    }
+  }
+
+  switch (typ) {
+  case LGLSXP:
+  case INTSXP:
+    p = nano_typed_copy(p, DATAPTR_RO(x), xlen * sizeof(int));
+    break;
+  case REALSXP:
+    p = nano_typed_copy(p, DATAPTR_RO(x), xlen * sizeof(double));
+    break;
+  case CPLXSXP:
+    p = nano_typed_copy(p, DATAPTR_RO(x), xlen * 2 * sizeof(double));
+    break;
+  case RAWSXP:
+    p = nano_typed_copy(p, DATAPTR_RO(x), xlen);
+    break;
+  case STRSXP:
+    if (dict != NULL) {
+      const uint64_t n = (uint64_t) dict->n;
+      memcpy(p, &n, sizeof(uint64_t));
+      p = nano_typed_write_str(p + sizeof(uint64_t), dict->uniq, dict->n);
+      p = nano_typed_copy(p, dict->codes, xlen * sizeof(int));
+    } else {
+      p = nano_typed_write_str(p, STRING_PTR_RO(x), (R_xlen_t) xlen);
+    }
+    break;
+  case VECSXP: {
+    const SEXP *x_p = VECTOR_PTR_RO(x);
+    for (uint64_t i = 0; i < xlen; i++)
+      p = nano_typed_write(p, x_p[i], ctx);
+    break;
+  }
+  }
+
+  return p;
+
+}
+
+static SEXP nano_typed_read_str(nano_buf *nb, const R_xlen_t n) {
+
+  SEXP out;
+  const size_t start = nb->cur;
+  if ((size_t) n > (nb->len - nb->cur) / sizeof(uint32_t))
+    return NULL;
+  PROTECT(out = Rf_allocVector(STRSXP, n));
+  for (R_xlen_t i = 0; i < n; i++) {
+    uint32_t slen;
+    if (nb->len - nb->cur < sizeof(uint32_t))
+      goto fail;
+    memcpy(&slen, nb->buf + nb->cur, sizeof(uint32_t));
+    nb->cur += sizeof(uint32_t);
+    if (slen == UINT32_MAX) {
+      SET_STRING_ELT(out, i, NA_STRING);
+      continue;
+    }
+    if (slen > INT_MAX || nb->len - nb->cur < slen ||
+        (slen && memchr(nb->buf + nb->cur, 0, slen) != NULL))
+      goto fail;
+    SET_STRING_ELT(out, i, Rf_mkCharLenCE((const char *) (nb->buf + nb->cur), (int) slen, CE_UTF8));
+    nb->cur += slen;
+  }
+
+  const size_t pad = NANO_ALIGN8(nb->cur - start) - (nb->cur - start);
+  if (nb->len - nb->cur < pad)
+    goto fail;
+  nb->cur += pad;
+
+  UNPROTECT(1);
+  return out;
+
+  fail:
+  UNPROTECT(1);
+  return NULL;
+
+}
+
+static SEXP nano_typed_read_strs(nano_buf *nb) {
+
+  uint64_t n;
+  if (nb->len - nb->cur < sizeof(uint64_t))
+    return NULL;
+  memcpy(&n, nb->buf + nb->cur, sizeof(uint64_t));
+  nb->cur += sizeof(uint64_t);
+  if (n > R_XLEN_T_MAX)
+    return NULL;
+
+  return nano_typed_read_str(nb, (R_xlen_t) n);
+
+}
+
+// Rf_classgets() errors on an empty class, or a 'factor' class other than on
+// an integer vector, and this must not longjmp with the message still held
+static int nano_typed_class_valid(const SEXP klass, const SEXPTYPE typ) {
+
+  const R_xlen_t n = XLENGTH(klass);
+  const SEXP *klass_p = STRING_PTR_RO(klass);
+  if (n == 0)
+    return 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (klass_p[i] != NA_STRING && !strcmp(CHAR(klass_p[i]), "factor"))
+      return typ == INTSXP;
+  }
+  return 1;
+
+}
+
+// Returns a C NULL on malformed input. Attributes are read into a protected
+// list (names, class, levels, row names) and set once the data is complete.
+static SEXP nano_typed_read(nano_buf *nb) {
+
+  SEXP out, attr, tmp;
+  uint32_t ndim;
+  uint64_t xlen;
+  size_t size;
+
+  if (nb->len - nb->cur < 16)
+    return NULL;
+
+  const unsigned char *p = nb->buf + nb->cur;
+  const SEXPTYPE typ = p[0];
+  const uint8_t flags = p[1];
+  memcpy(&ndim, p + 4, sizeof(uint32_t));
+  memcpy(&xlen, p + 8, sizeof(uint64_t));
+  nb->cur += 16;
+
+  // NULL carries no attributes
+  if (xlen > R_XLEN_T_MAX || ndim > (nb->len - nb->cur) / sizeof(int) ||
+      (typ == NILSXP && (flags || ndim)))
+    return NULL;
+
+  const size_t dimsz = NANO_ALIGN8((size_t) ndim * sizeof(int));
+  if (nb->len - nb->cur < dimsz)
+    return NULL;
+  const unsigned char *dimp = nb->buf + nb->cur;
+  nb->cur += dimsz;
+
+  if (ndim) {
+    double prod = 1;
+    for (uint32_t i = 0; i < ndim; i++) {
+      int d;
+      memcpy(&d, dimp + i * sizeof(int), sizeof(int));
+      if (d < 0) return NULL;
+      prod *= d;
+    }
+    if (prod != (double) xlen)
+      return NULL;
+  }
+
+  PROTECT(attr = Rf_allocVector(VECSXP, 4));
+  if (flags & NANO_TYPED_NAMES) {
+    if ((tmp = nano_typed_read_str(nb, (R_xlen_t) xlen)) == NULL) goto fail;
+    SET_VECTOR_ELT(attr, 0, tmp);
+  }
+  if (flags & NANO_TYPED_CLASS) {
+    if ((tmp = nano_typed_read_strs(nb)) == NULL || !nano_typed_class_valid(tmp, typ)) goto fail;
+    SET_VECTOR_ELT(attr, 1, tmp);
+  }
+  if (flags & NANO_TYPED_LEVELS) {
+    if (typ != INTSXP || (tmp = nano_typed_read_strs(nb)) == NULL) goto fail;
+    SET_VECTOR_ELT(attr, 2, tmp);
+  }
+  if (flags & NANO_TYPED_ROWNAMES) {
+    if (typ != VECSXP || (tmp = nano_typed_read(nb)) == NULL ||
+        (TYPEOF(tmp) != INTSXP && TYPEOF(tmp) != STRSXP)) goto fail;
+    SET_VECTOR_ELT(attr, 3, tmp);
+  }
+
+  switch (typ) {
+  case NILSXP:
+    UNPROTECT(1);
+    return R_NilValue;
+  case LGLSXP:
+  case INTSXP:
+    size = sizeof(int);
+    break;
+  case REALSXP:
+    size = sizeof(double);
+    break;
+  case CPLXSXP:
+    size = 2 * sizeof(double);
+    break;
+  case RAWSXP:
+    size = 1;
+    break;
+  case STRSXP:
+    if (flags & NANO_TYPED_DICT) {
+      SEXP dict;
+      if ((dict = nano_typed_read_strs(nb)) == NULL ||
+          xlen > (nb->len - nb->cur) / sizeof(int) ||
+          nb->len - nb->cur < NANO_ALIGN8(xlen * sizeof(int)))
+        goto fail;
+      PROTECT(dict);
+      const R_xlen_t n = XLENGTH(dict);
+      const SEXP *dict_p = STRING_PTR_RO(dict);
+      const unsigned char *codes = nb->buf + nb->cur;
+      PROTECT(out = Rf_allocVector(STRSXP, (R_xlen_t) xlen));
+      for (uint64_t i = 0; i < xlen; i++) {
+        int code;
+        memcpy(&code, codes + i * sizeof(int), sizeof(int));
+        if (code == NA_INTEGER) {
+          SET_STRING_ELT(out, (R_xlen_t) i, NA_STRING);
+        } else if (code >= 0 && code < n) {
+          SET_STRING_ELT(out, (R_xlen_t) i, dict_p[code]);
+        } else {
+          UNPROTECT(2);
+          goto fail;
+        }
+      }
+      nb->cur += NANO_ALIGN8(xlen * sizeof(int));
+      UNPROTECT(2);
+      PROTECT(out);
+    } else {
+      if ((out = nano_typed_read_str(nb, (R_xlen_t) xlen)) == NULL)
+        goto fail;
+      PROTECT(out);
+    }
+    goto attrib;
+  case VECSXP:
+    if (xlen > (nb->len - nb->cur) / 16)
+      goto fail;
+    R_CheckStack();
+    PROTECT(out = Rf_allocVector(VECSXP, (R_xlen_t) xlen));
+    for (uint64_t i = 0; i < xlen; i++) {
+      SEXP item = nano_typed_read(nb);
+      if (item == NULL) {
+        UNPROTECT(1);
+        goto fail;
+      }
+      SET_VECTOR_ELT(out, (R_xlen_t) i, item);
+    }
+    goto attrib;
+  default:
+    goto fail;
+  }
+
+  if (xlen > (nb->len - nb->cur) / size || nb->len - nb->cur < NANO_ALIGN8(xlen * size))
+    goto fail;
+  PROTECT(out = Rf_allocVector(typ, (R_xlen_t) xlen));
+  if (xlen)
+    memcpy(NANO_DATAPTR(out), nb->buf + nb->cur, xlen * size);
+  nb->cur += NANO_ALIGN8(xlen * size);
+  if (typ == LGLSXP) {
+    int *lgl = (int *) NANO_DATAPTR(out);
+    for (uint64_t i = 0; i < xlen; i++) {
+      if (lgl[i] != NA_LOGICAL && lgl[i] != 0) lgl[i] = 1;
+    }
+  }
+
+  attrib:
+  if (ndim) {
+    SEXP dim = Rf_allocVector(INTSXP, ndim);
+    memcpy(NANO_DATAPTR(dim), dimp, ndim * sizeof(int));
+    Rf_setAttrib(out, R_DimSymbol, dim);
+  }
+  const SEXP *attr_p = VECTOR_PTR_RO(attr);
+  if (attr_p[0] != R_NilValue)
+    Rf_setAttrib(out, R_NamesSymbol, attr_p[0]);
+  if (attr_p[3] != R_NilValue)
+    Rf_setAttrib(out, R_RowNamesSymbol, attr_p[3]);
+  if (attr_p[2] != R_NilValue)
+    Rf_setAttrib(out, R_LevelsSymbol, attr_p[2]);
+  if (attr_p[1] != R_NilValue)
+    Rf_classgets(out, attr_p[1]);
+
+  UNPROTECT(2);
+  return out;
+
+  fail:
+  UNPROTECT(1);
+  return NULL;
+
+}
+
+static SEXP nano_decode_typed(unsigned char *buf, const size_t sz) {
+
+  SEXP out = NULL;
+  if (sz >= 8 && !memcmp(buf, nano_typed_magic, 4) && !memcmp(buf + 4, &nano_typed_bom, 4)) {
+    nano_buf nb = {.buf = buf, .len = sz, .cur = 8};
+    out = nano_typed_read(&nb);
+  }
+
+  if (out == NULL) {
+    Rf_warningcall_immediate(R_NilValue, "received data could not be converted to typed");
+    out = Rf_allocVector(RAWSXP, sz);
+    if (sz)
+      memcpy(NANO_DATAPTR(out), buf, sz);
+  }
+
+  return out;
+
+}
+
 // Serialization Hooks - this section only subject to copyright notice: --------
 
 /*
@@ -93,18 +851,10 @@ static int nano_read_char(R_inpstream_t stream) {
 
 static SEXP nano_serialize_hook(SEXP x, SEXP hook_func) {
 
-  SEXP klass = nano_bundle.klass;
-  int len = (int) XLENGTH(klass), match = 0, i;
-  const SEXP *klass_p = STRING_PTR_RO(klass);
+  const SEXP *klass_p = STRING_PTR_RO(nano_bundle.klass);
+  int i = nano_hook_match(x);
 
-  for (i = 0; i < len; i++) {
-    if (Rf_inherits(x, CHAR(klass_p[i]))) {
-      match = 1;
-      break;
-    }
-  }
-
-  if (!match)
+  if (i < 0)
     return R_NilValue;
 
   R_outpstream_t stream = nano_bundle.outpstream;
@@ -204,8 +954,9 @@ void listener_finalizer(SEXP xptr) {
 void socket_finalizer(SEXP xptr) {
 
   if (NANO_PTR(xptr) == NULL) return;
-  nng_socket *xp = (nng_socket *) NANO_PTR(xptr);
-  nng_close(*xp);
+  nano_sockctx *xp = (nano_sockctx *) NANO_PTR(xptr);
+  nng_close(xp->sock);
+  nng_aio_free(xp->sync.aio);
   free(xp);
 
 }
@@ -304,7 +1055,9 @@ SEXP nano_url_with_port(nng_url *up, int port) {
 
 void nano_serialize(nano_buf *buf, SEXP object, SEXP hook, int header, size_t headroom) {
 
-  NANO_ALLOC(buf, NANONEXT_INIT_BUFSIZE);
+  const size_t est = nano_serial_size(object);
+  const size_t sz = est && est < R_XLEN_T_MAX ? headroom + 8 + NANO_SERIAL_HDR + est : 0;
+  NANO_ALLOC(buf, sz > NANONEXT_INIT_BUFSIZE ? sz : NANONEXT_INIT_BUFSIZE);
   struct R_outpstream_st output_stream;
 
   // Reserve headroom so a zero-copy body (nano_msg_set_body) leaves room for
@@ -323,6 +1076,8 @@ void nano_serialize(nano_buf *buf, SEXP object, SEXP hook, int header, size_t he
   if (hook != R_NilValue) {
     nano_bundle.klass = VECTOR_PTR_RO(hook)[0];
     nano_bundle.outpstream = &output_stream;
+    nano_bundle.cache_n = 0;
+    PROTECT(nano_bundle.cache = Rf_allocVector(VECSXP, NANO_HOOK_CACHE));
   }
 
   R_InitOutPStream(
@@ -338,6 +1093,9 @@ void nano_serialize(nano_buf *buf, SEXP object, SEXP hook, int header, size_t he
 
   R_Serialize(object, &output_stream);
 
+  if (hook != R_NilValue)
+    UNPROTECT(1);
+
 }
 
 void nano_msg_set_body(nng_msg *msg, nano_buf *buf, size_t headroom) {
@@ -481,6 +1239,8 @@ SEXP nano_decode(unsigned char *buf, const size_t sz, const uint8_t mod, SEXP ho
     break;
   case 9:
     return nano_raw_char(buf, sz);
+  case 10:
+    return nano_decode_typed(buf, sz);
   default:
     return nano_unserialize(buf, sz, hook);
   }
@@ -492,6 +1252,79 @@ SEXP nano_decode(unsigned char *buf, const size_t sz, const uint8_t mod, SEXP ho
 
 }
 
+// size of an atomic vector in mode 'raw'
+static size_t nano_encode_size(const SEXP object) {
+
+  switch (TYPEOF(object)) {
+  case STRSXP: {
+    const R_xlen_t xlen = XLENGTH(object);
+    const SEXP *object_p = STRING_PTR_RO(object);
+    size_t outlen = 0;
+    for (R_xlen_t i = 0; i < xlen; i++)
+      outlen += strlen(CHAR(object_p[i])) + 1;
+    return outlen;
+  }
+  case REALSXP:
+    return XLENGTH(object) * sizeof(double);
+  case INTSXP:
+  case LGLSXP:
+    return XLENGTH(object) * sizeof(int);
+  case CPLXSXP:
+    return XLENGTH(object) * 2 * sizeof(double);
+  case RAWSXP:
+    return XLENGTH(object);
+  case NILSXP:
+    return 0;
+  default:
+    Rf_error("`data` must be an atomic vector type, NULL or a list thereof to send in mode 'raw'");
+  }
+
+}
+
+// sets iov entries for a list of atomic vectors sent on a Stream, pointing at
+// the vectors themselves, with any framing written to hdr (of at least 8
+// bytes) - returns the number of entries, 0 if the list is not suitable, or
+// -xc if it cannot be framed
+int nano_encode_iov(const nano_framer *f, nng_iov *iov, unsigned char *hdr, const SEXP object) {
+
+  const R_xlen_t xlen = XLENGTH(object);
+  const SEXP *object_p = VECTOR_PTR_RO(object);
+  const size_t over = f == NULL ? 0 : nano_frame_overhead(f);
+  const int prefix = f != NULL && NANO_FRAME_PREFIXED(f);
+  const int limit = NANO_IOV_MAX - (over && !prefix);
+  int n = prefix;
+  size_t total = 0;
+
+  for (R_xlen_t i = 0; i < xlen; i++) {
+    const SEXP x = object_p[i];
+    const size_t sz = nano_encode_size(x);
+    if (!sz) continue;
+    if (n == limit || (TYPEOF(x) == STRSXP && XLENGTH(x) != 1))
+      return 0;
+    iov[n].iov_buf = TYPEOF(x) == STRSXP ? (void *) CHAR(STRING_ELT(x, 0)) : (void *) DATAPTR_RO(x);
+    iov[n].iov_len = sz;
+    total += sz;
+    n++;
+  }
+  if (!total)
+    return 0;
+
+  int xc;
+  if (f != NULL && (xc = nano_frame_check(f, total)))
+    return -xc;
+  if (prefix) {
+    iov[0].iov_buf = hdr;
+    iov[0].iov_len = nano_frame_header(f, hdr, total);
+  } else if (over) {
+    iov[n].iov_buf = hdr;
+    iov[n].iov_len = nano_frame_header(f, hdr, total);
+    n++;
+  }
+
+  return n;
+
+}
+
 void nano_encode(nano_buf *enc, const SEXP object) {
 
   switch (TYPEOF(object)) {
@@ -533,16 +1366,51 @@ void nano_encode(nano_buf *enc, const SEXP object) {
   case NILSXP:
     NANO_INIT(enc, NULL, 0);
     break;
+  case VECSXP: {
+    // parts are gathered into a single allocation
+    const R_xlen_t xlen = XLENGTH(object);
+    const SEXP *object_p = VECTOR_PTR_RO(object);
+    size_t outlen = 0;
+    for (R_xlen_t i = 0; i < xlen; i++)
+      outlen += nano_encode_size(object_p[i]);
+    NANO_ALLOC(enc, outlen ? outlen : 1);
+    nano_buf part;
+    for (R_xlen_t i = 0; i < xlen; i++) {
+      nano_encode(&part, object_p[i]);
+      if (part.cur)
+        memcpy(enc->buf + enc->cur, part.buf, part.cur);
+      enc->cur += part.cur;
+      NANO_FREE(part);
+    }
+    break;
+  }
   default:
-    Rf_error("`data` must be an atomic vector type or NULL to send in mode 'raw'");
+    Rf_error("`data` must be an atomic vector type, NULL or a list thereof to send in mode 'raw'");
   }
 
 }
 
+void nano_encode_typed(nano_buf *enc, const SEXP object, size_t headroom) {
+
+  nano_typed_ctx ctx = {NULL, NULL};
+  const void *vmax = vmaxget();
+  const size_t sz = 8 + nano_typed_size(object, &ctx);
+  NANO_ALLOC(enc, headroom + sz);
+  unsigned char *p = enc->buf + headroom;
+  memcpy(p, nano_typed_magic, 4);
+  memcpy(p + 4, &nano_typed_bom, 4);
+  nano_typed_write(p + 8, object, &ctx);
+  vmaxset(vmax);
+  enc->cur = headroom + sz;
+
+}
+
 int nano_encode_mode(const SEXP mode) {
 
-  if (TYPEOF(mode) == INTSXP)
-    return NANO_INTEGER(mode) == 2;
+  if (TYPEOF(mode) == INTSXP) {
+    const int mod = NANO_INTEGER(mode);
+    return mod == 2 || mod == 3 ? mod - 1 : 0;
+  }
 
   const char *mod = CHAR(STRING_ELT(mode, 0));
   const size_t slen = strlen(mod);
@@ -551,12 +1419,15 @@ int nano_encode_mode(const SEXP mode) {
   case 3:
     if (!memcmp(mod, "raw", slen)) return 1;
     break;
+  case 5:
+    if (!memcmp(mod, "typed", slen)) return 2;
+    break;
   case 6:
     if (!memcmp(mod, "serial", slen)) return 0;
     break;
   }
 
-  Rf_error("`mode` should be one of: serial, raw");
+  Rf_error("`mode` should be one of: serial, raw, typed");
 
 }
 
@@ -572,6 +1443,9 @@ uint8_t nano_matcharg(const SEXP mode) {
   case 3:
     if (!memcmp(mod, "raw", slen)) { i = 8; break; }
     goto fail;
+  case 5:
+    if (!memcmp(mod, "typed", slen)) { i = 10; break; }
+    goto fail;
   case 6:
     if (!memcmp(mod, "serial", slen)) { i = 1; break; }
     if (!memcmp(mod, "double", slen)) { i = 4; break; }
@@ -593,7 +1467,7 @@ uint8_t nano_matcharg(const SEXP mode) {
   return i;
 
   fail:
-  Rf_error("`mode` should be one of: serial, character, complex, double, integer, logical, numeric, raw, string");
+  Rf_error("`mode` should be one of: serial, character, complex, double, integer, logical, numeric, raw, string, typed");
 
 }
 
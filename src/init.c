@@ -5,6 +5,7 @@
 void (*eln2)(void (*)(void *), void *, double, int) = NULL;
 
 SEXP nano_AioSymbol;
+SEXP nano_BrokerSymbol;
 SEXP nano_ContextSymbol;
 SEXP nano_CvSymbol;
 SEXP nano_DataSymbol;
@@ -14,7 +15,10 @@ SEXP nano_HeadersSymbol;
 SEXP nano_IdSymbol;
 SEXP nano_ListenerSymbol;
 SEXP nano_MonitorSymbol;
+SEXP nano_OffsetsSymbol;
+SEXP nano_PipelineSymbol;
 SEXP nano_ProtocolSymbol;
+SEXP nano_ReceiverSymbol;
 SEXP nano_ResolveSymbol;
 SEXP nano_ResponseSymbol;
 SEXP nano_ResultSymbol;
@@ -23,6 +27,7 @@ SEXP nano_StateSymbol;
 SEXP nano_StatusSymbol;
 SEXP nano_StreamSymbol;
 SEXP nano_ThreadSymbol;
+SEXP nano_TimerSymbol;
 SEXP nano_TlsSymbol;
 SEXP nano_UrlSymbol;
 SEXP nano_ValueSymbol;
@@ -33,6 +38,7 @@ SEXP nano_aioFuncMsg;
 SEXP nano_aioFuncRes;
 SEXP nano_aioNFuncs;
 SEXP nano_error;
+SEXP nano_liteAio;
 SEXP nano_precious;
 SEXP nano_recvAio;
 SEXP nano_reqAio;
@@ -42,6 +48,7 @@ SEXP nano_unresolved;
 
 static void RegisterSymbols(void) {
   nano_AioSymbol = Rf_install("aio");
+  nano_BrokerSymbol = Rf_install("broker");
   nano_ConnSymbol = Rf_install("conn");
   nano_ContextSymbol = Rf_install("context");
   nano_CvSymbol = Rf_install("cv");
@@ -53,7 +60,10 @@ static void RegisterSymbols(void) {
   nano_IdSymbol = Rf_install("id");
   nano_ListenerSymbol = Rf_install("listener");
   nano_MonitorSymbol = Rf_install("monitor");
+  nano_OffsetsSymbol = Rf_install("offsets");
+  nano_PipelineSymbol = Rf_install("pipeline");
   nano_ProtocolSymbol = Rf_install("protocol");
+  nano_ReceiverSymbol = Rf_install("receiver");
   nano_ResolveSymbol = Rf_install("resolve");
   nano_ResponseSymbol = Rf_install("response");
   nano_ResultSymbol = Rf_install("result");
@@ -62,6 +72,7 @@ static void RegisterSymbols(void) {
   nano_StatusSymbol = Rf_install("status");
   nano_StreamSymbol = Rf_install("stream");
   nano_ThreadSymbol = Rf_install("thread");
+  nano_TimerSymbol = Rf_install("timer");
   nano_TlsSymbol = Rf_install("tls");
   nano_UrlSymbol = Rf_install("url");
   nano_ValueSymbol = Rf_install("value");
@@ -77,6 +88,7 @@ static void PreserveObjects(void) {
   R_PreserveObject(nano_error = Rf_allocVector(STRSXP, 2));
   SET_STRING_ELT(nano_error, 0, Rf_mkChar("errorValue"));
   SET_STRING_ELT(nano_error, 1, Rf_mkChar("try-error"));
+  R_PreserveObject(nano_liteAio = Rf_mkString("nanoAio"));
   R_PreserveObject(nano_precious = Rf_cons(R_NilValue, R_NilValue));
   R_PreserveObject(nano_recvAio = Rf_mkString("recvAio"));
   R_PreserveObject(nano_reqAio = Rf_allocVector(STRSXP, 2));
@@ -96,6 +108,7 @@ static void ReleaseObjects(void) {
   R_ReleaseObject(nano_reqAio);
   R_ReleaseObject(nano_recvAio);
   R_ReleaseObject(nano_precious);
+  R_ReleaseObject(nano_liteAio);
   R_ReleaseObject(nano_error);
   R_ReleaseObject(nano_aioNFuncs);
   R_ReleaseObject(nano_aioFuncRes);
@@ -109,17 +122,23 @@ static const R_CallMethodDef callMethods[] = {
   {"rnng_aio_collect", (DL_FUNC) &rnng_aio_collect, 1},
   {"rnng_aio_collect_safe", (DL_FUNC) &rnng_aio_collect_safe, 1},
   {"rnng_aio_get_msg", (DL_FUNC) &rnng_aio_get_msg, 1},
+  {"rnng_aio_lite", (DL_FUNC) &rnng_aio_lite, 2},
+  {"rnng_aio_pool", (DL_FUNC) &rnng_aio_pool, 0},
   {"rnng_aio_http_data", (DL_FUNC) &rnng_aio_http_data, 1},
   {"rnng_aio_http_headers", (DL_FUNC) &rnng_aio_http_headers, 1},
   {"rnng_aio_http_status", (DL_FUNC) &rnng_aio_http_status, 1},
   {"rnng_aio_result", (DL_FUNC) &rnng_aio_result, 1},
   {"rnng_aio_stop", (DL_FUNC) &rnng_aio_stop, 1},
+  {"rnng_broker_aio", (DL_FUNC) &rnng_broker_aio, 4},
+  {"rnng_broker_stats", (DL_FUNC) &rnng_broker_stats, 1},
   {"rnng_clock", (DL_FUNC) &rnng_clock, 0},
   {"rnng_close", (DL_FUNC) &rnng_close, 1},
   {"rnng_conn_close", (DL_FUNC) &rnng_conn_close, 1},
   {"rnng_ctx_close", (DL_FUNC) &rnng_ctx_close, 1},
   {"rnng_ctx_create", (DL_FUNC) &rnng_ctx_create, 1},
   {"rnng_ctx_open", (DL_FUNC) &rnng_ctx_open, 1},
+  {"rnng_cq_alloc", (DL_FUNC) &rnng_cq_alloc, 0},
+  {"rnng_cq_next", (DL_FUNC) &rnng_cq_next, 2},
   {"rnng_cv_alloc", (DL_FUNC) &rnng_cv_alloc, 0},
   {"rnng_cv_reset", (DL_FUNC) &rnng_cv_reset, 1},
   {"rnng_cv_signal", (DL_FUNC) &rnng_cv_signal, 1},
@@ -150,6 +169,7 @@ static const R_CallMethodDef callMethods[] = {
   {"rnng_ip_addr", (DL_FUNC) &rnng_ip_addr, 0},
   {"rnng_is_error_value", (DL_FUNC) &rnng_is_error_value, 1},
   {"rnng_is_nul_byte", (DL_FUNC) &rnng_is_nul_byte, 1},
+  {"rnng_later_latency", (DL_FUNC) &rnng_later_latency, 1},
   {"rnng_listen", (DL_FUNC) &rnng_listen, 5},
   {"rnng_listener_close", (DL_FUNC) &rnng_listener_close, 1},
   {"rnng_listener_start", (DL_FUNC) &rnng_listener_start, 1},
@@ -162,17 +182,26 @@ static const R_CallMethodDef callMethods[] = {
   {"rnng_ncurl_session_close", (DL_FUNC) &rnng_ncurl_session_close, 1},
   {"rnng_ncurl_transact", (DL_FUNC) &rnng_ncurl_transact, 1},
   {"rnng_pipe_notify", (DL_FUNC) &rnng_pipe_notify, 5},
+  {"rnng_pipeline_aio", (DL_FUNC) &rnng_pipeline_aio, 4},
+  {"rnng_pipeline_stats", (DL_FUNC) &rnng_pipeline_stats, 1},
   {"rnng_protocol_open", (DL_FUNC) &rnng_protocol_open, 6},
   {"rnng_race_aio", (DL_FUNC) &rnng_race_aio, 2},
   {"rnng_random", (DL_FUNC) &rnng_random, 2},
   {"rnng_read_stdin", (DL_FUNC) &rnng_read_stdin, 1},
   {"rnng_reap", (DL_FUNC) &rnng_reap, 1},
+  {"rnng_receiver_close", (DL_FUNC) &rnng_receiver_close, 1},
+  {"rnng_receiver_create", (DL_FUNC) &rnng_receiver_create, 5},
   {"rnng_recv", (DL_FUNC) &rnng_recv, 3},
   {"rnng_recv_aio", (DL_FUNC) &rnng_recv_aio, 5},
+  {"rnng_recv_batch", (DL_FUNC) &rnng_recv_batch, 4},
+  {"rnng_recv_file", (DL_FUNC) &rnng_recv_file, 4},
+  {"rnng_recv_into", (DL_FUNC) &rnng_recv_into, 4},
   {"rnng_request", (DL_FUNC) &rnng_request, 8},
   {"rnng_request_stop", (DL_FUNC) &rnng_request_stop, 1},
   {"rnng_send", (DL_FUNC) &rnng_send, 5},
   {"rnng_send_aio", (DL_FUNC) &rnng_send_aio, 6},
+  {"rnng_send_batch_aio", (DL_FUNC) &rnng_send_batch_aio, 6},
+  {"rnng_send_file", (DL_FUNC) &rnng_send_file, 5},
   {"rnng_serial_config", (DL_FUNC) &rnng_serial_config, 3},
   {"rnng_set_opt", (DL_FUNC) &rnng_set_opt, 3},
   {"rnng_set_promise_context", (DL_FUNC) &rnng_set_promise_context, 2},
@@ -184,9 +213,16 @@ static const R_CallMethodDef callMethods[] = {
   {"rnng_stream_conn_send", (DL_FUNC) &rnng_stream_conn_send, 2},
   {"rnng_stream_conn_set_header", (DL_FUNC) &rnng_stream_conn_set_header, 3},
   {"rnng_stream_conn_set_status", (DL_FUNC) &rnng_stream_conn_set_status, 2},
-  {"rnng_stream_open", (DL_FUNC) &rnng_stream_open, 6},
+  {"rnng_stream_open", (DL_FUNC) &rnng_stream_open, 7},
   {"rnng_strerror", (DL_FUNC) &rnng_strerror, 1},
   {"rnng_subscribe", (DL_FUNC) &rnng_subscribe, 3},
+  {"rnng_thread_info", (DL_FUNC) &rnng_thread_info, 0},
+  {"rnng_threads", (DL_FUNC) &rnng_threads, 4},
+  {"rnng_timer_cancel", (DL_FUNC) &rnng_timer_cancel, 2},
+  {"rnng_timer_send", (DL_FUNC) &rnng_timer_send, 6},
+  {"rnng_timer_signal", (DL_FUNC) &rnng_timer_signal, 4},
+  {"rnng_timer_timeout", (DL_FUNC) &rnng_timer_timeout, 3},
+  {"rnng_timer_wheel", (DL_FUNC) &rnng_timer_wheel, 2},
   {"rnng_tls_config", (DL_FUNC) &rnng_tls_config, 4},
   {"rnng_traverse_precious", (DL_FUNC) &rnng_traverse_precious, 0},
   {"rnng_unresolved", (DL_FUNC) &rnng_unresolved, 1},
@@ -204,7 +240,6 @@ static const R_CallMethodDef callMethods[] = {
 void attribute_visible R_init_nanonext(DllInfo* dll) {
   RegisterSymbols();
   PreserveObjects();
-  nano_list_do(INIT, NULL);
   R_registerRoutines(dll, NULL, callMethods, NULL, NULL);
   R_useDynamicSymbols(dll, FALSE);
   R_forceSymbols(dll, TRUE);
@@ -42,6 +42,18 @@ typedef struct nano_handle_s {
 
 #ifdef NANONEXT_IO
 #include <stdio.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <io.h>
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #endif
 
 #ifdef NANONEXT_NET
@@ -123,7 +135,9 @@ extern int R_interrupts_pending;
 #define ERROR_OUT(xc) Rf_error("%d | %s", xc, nng_strerror(xc))
 #define ERROR_RET(xc) { Rf_warning("%d | %s", xc, nng_strerror(xc)); return mk_error(xc); }
 #define NANONEXT_INIT_BUFSIZE 4096
+#define NANO_ARENA_INIT 65536
 #define NANO_HEADROOM 32
+#define NANO_IOV_MAX 8 // iov entries held by an nng aio
 #define NANONEXT_SERIAL_VER 3
 #define NANONEXT_SERIAL_THR 67108864
 #define NANONEXT_CHUNK_SIZE 67108864 // must be <= INT_MAX
@@ -147,6 +161,9 @@ extern int R_interrupts_pending;
   SET_STRING_ELT(klass, 1, Rf_mkChar(cls2))
 #define NANO_ENSURE_ALLOC(x) if (x == NULL) { xc = 2; goto failmem; }
 #define NANO_URL_MAX 8192
+#define NANO_HOOK_CACHE 8
+#define NANO_POOL_MAX 256
+#define NANO_ALIGN8(x) (((size_t) (x) + 7) & ~((size_t) 7))
 
 typedef union nano_opt_u {
   char *str;
@@ -157,8 +174,65 @@ typedef union nano_opt_u {
   bool b;
 } nano_opt;
 
+typedef enum nano_framing {
+  NANO_FRAME_NONE,
+  NANO_FRAME_U32,
+  NANO_FRAME_U64,
+  NANO_FRAME_LF,
+  NANO_FRAME_CRLF,
+  NANO_FRAME_FIXED
+} nano_framing;
+
+#define NANO_FRAME_PREFIXED(f) ((f)->framing == NANO_FRAME_U32 || (f)->framing == NANO_FRAME_U64)
+
+// receive buffer of a byte stream, shared with its in-flight Aio: parses
+// frames if framed, or else is a reusable arena (with framing NONE)
+typedef struct nano_framer_s {
+  nng_stream *stream;
+  nng_mtx *mtx;
+  unsigned char *buf;
+  size_t cap;
+  size_t head;
+  size_t len;
+  size_t max;
+  nano_framing framing;
+  int refs;
+  int busy;
+  int closed;
+  int failed;
+} nano_framer;
+
+// an arena lent for decoding, returned by nano_arena_cleanup()
+typedef struct nano_adecode_s {
+  nano_framer *arena;
+  unsigned char *buf;
+  size_t sz;
+  uint8_t mod;
+  SEXP hook;
+} nano_adecode;
+
+// aio kept on a connection for synchronous timed operations, taken only when
+// not already busy
+typedef struct nano_syncaio_s {
+  nng_aio *aio;
+  int busy;
+} nano_syncaio;
+
+// a Socket or Context - the nng handle comes first, so the pointer may also be
+// used as an nng_socket or nng_ctx pointer
+typedef struct nano_sockctx_s {
+  union {
+    nng_socket sock;
+    nng_ctx ctx;
+  };
+  nano_syncaio sync;
+} nano_sockctx;
+
 typedef struct nano_stream_s {
   nng_stream *stream;
+  nano_framer *frm;
+  nano_framer *arena;
+  nano_syncaio sync;
   union {
     nng_stream_dialer *dial;
     nng_stream_listener *list;
@@ -182,7 +256,8 @@ typedef enum nano_aio_typ {
   HTTP_AIO,
   RECVAIOS,
   REQAIOS,
-  IOV_RECVAIOS
+  IOV_RECVAIOS,
+  BATCH_SENDAIO
 } nano_aio_typ;
 
 typedef struct nano_aio_s {
@@ -190,11 +265,90 @@ typedef struct nano_aio_s {
   void *data;
   void *cb;
   void *next;
+  nano_framer *arena;
   int result;
+  int qid;
   nano_aio_typ type;
   uint8_t mode;
+  uint8_t pool;
+  uint8_t framed;
 } nano_aio;
 
+typedef struct nano_batch_s {
+  union {
+    nng_socket sock;
+    nng_ctx ctx;
+  } con;
+  nng_msg **msgs;
+  int *status;
+  R_xlen_t n;
+  R_xlen_t cur;
+  int sock;
+  int started;
+} nano_batch;
+
+typedef enum nano_stage_op {
+  STAGE_PREFIX,
+  STAGE_STRIP,
+  STAGE_PREPEND,
+  STAGE_MIN,
+  STAGE_MAX
+} nano_stage_op;
+
+typedef struct nano_stage_s {
+  nano_stage_op op;
+  size_t len;
+  unsigned char *buf;
+} nano_stage;
+
+typedef struct nano_pipeline_s nano_pipeline;
+
+typedef struct nano_ptarget_s {
+  nano_pipeline *p;
+  nng_aio *aio;
+  nng_socket sock;
+} nano_ptarget;
+
+struct nano_pipeline_s {
+  nng_socket from;
+  nng_aio *raio;
+  nng_aio *sentinel;
+  nng_mtx *mtx;
+  nano_ptarget *targets;
+  nano_stage *stages;
+  nng_msg **out;
+  int n;
+  int nstages;
+  int pending;
+  int stopped;
+  double stats[4]; // received, dropped, sent and failed messages
+};
+
+typedef struct nano_broker_s nano_broker;
+
+// one per socket of a broker: index 0 is the frontend, the rest backends
+typedef struct nano_bside_s {
+  nano_broker *b;
+  nng_socket sock;
+  nng_aio *send;
+  nng_aio *recv;
+  nng_aio *reply;
+  size_t len;
+  size_t rlen;
+  double stats[4];
+  int depth;
+} nano_bside;
+
+struct nano_broker_s {
+  nng_aio *sentinel;
+  nng_mtx *mtx;
+  nano_bside *sides;
+  int n;
+  int next;
+  int least;
+  int stopped;
+};
+
 typedef struct nano_saio_s {
   nng_aio *aio;
   void *disp;
@@ -203,11 +357,21 @@ typedef struct nano_saio_s {
   int type;
 } nano_saio;
 
+typedef struct nano_cq_s {
+  int *queue;
+  int *slots;
+  int head;
+  int count;
+  int nfree;
+  int size;
+} nano_cq;
+
 typedef struct nano_cv_s {
   int condition;
   int flag;
   nng_mtx *mtx;
   nng_cv *cv;
+  nano_cq *cq;
 } nano_cv;
 
 typedef struct nano_monitor_s {
@@ -217,11 +381,81 @@ typedef struct nano_monitor_s {
   int updates;
 } nano_monitor;
 
-typedef struct nano_thread_aio_s {
-  nng_thread *thr;
+typedef struct nano_receiver_s nano_receiver;
+
+typedef struct nano_rslot_s {
+  nng_aio *aio;
+  nano_receiver *rcv;
+  int parked;
+} nano_rslot;
+
+struct nano_receiver_s {
+  union {
+    nng_socket sock;
+    nng_ctx ctx;
+  } con;
+  nano_rslot *slots;
+  nng_msg **ring;
   nano_cv *cv;
+  nng_mtx *mtx;
+  nng_cv *ready;
+  size_t head;
+  size_t count;
+  size_t capacity;
+  int n;
+  int posted;
+  int sock;
+  int drop;
+  int closed;
+};
+
+#define NANO_WHEEL_BITS 6
+#define NANO_WHEEL_SLOTS (1 << NANO_WHEEL_BITS)
+#define NANO_WHEEL_LEVELS 4
+
+typedef enum nano_timer_op {
+  NANO_TIMER_SEND,
+  NANO_TIMER_SEND_CTX,
+  NANO_TIMER_SIGNAL,
+  NANO_TIMER_TIMEOUT
+} nano_timer_op;
+
+typedef struct nano_timer_s {
+  struct nano_timer_s *prev;
+  struct nano_timer_s *next;
+  union {
+    nng_socket sock;
+    nng_ctx ctx;
+    nano_cv *cv;
+    nng_aio *aio;
+  } tgt;
+  nng_msg *msg;
+  uint64_t expire;
+  uint64_t interval;
+  int id;
+  int armed;
+  nano_timer_op op;
+} nano_timer;
+
+typedef struct nano_wheel_s {
+  nano_timer *slots[NANO_WHEEL_LEVELS][NANO_WHEEL_SLOTS];
+  nano_timer *timers;
+  int *free;
+  int *done;
   nng_aio *aio;
-} nano_thread_aio;
+  nng_mtx *mtx;
+  nng_cv *idle;
+  nng_time start;
+  nng_duration res;
+  uint64_t tick;
+  int capacity;
+  int nfree;
+  int ndone;
+  int active;
+  int running;
+  int firing;
+  int closed;
+} nano_wheel;
 
 typedef struct nano_thread_duo_s {
   nng_thread *thr;
@@ -239,10 +473,20 @@ typedef struct nano_serial_bundle_s {
   R_outpstream_t outpstream;
   R_inpstream_t inpstream;
   SEXP klass;
+  SEXP cache;
+  int cache_match[NANO_HOOK_CACHE];
+  int cache_n;
 } nano_serial_bundle;
 
+typedef enum nano_pool_typ {
+  NANO_POOL_NONE,
+  NANO_POOL_SEND,
+  NANO_POOL_RECV,
+  NANO_POOL_REQ,
+  NANO_POOLS
+} nano_pool_typ;
+
 typedef enum nano_list_op {
-  INIT,
   FINALIZE,
   COMPLETE,
   FREE,
@@ -359,6 +603,7 @@ typedef struct ws_message_s {
 extern void (*eln2)(void (*)(void *), void *, double, int);
 
 extern SEXP nano_AioSymbol;
+extern SEXP nano_BrokerSymbol;
 extern SEXP nano_ContextSymbol;
 extern SEXP nano_CvSymbol;
 extern SEXP nano_DataSymbol;
@@ -368,7 +613,10 @@ extern SEXP nano_HeadersSymbol;
 extern SEXP nano_IdSymbol;
 extern SEXP nano_ListenerSymbol;
 extern SEXP nano_MonitorSymbol;
+extern SEXP nano_OffsetsSymbol;
+extern SEXP nano_PipelineSymbol;
 extern SEXP nano_ProtocolSymbol;
+extern SEXP nano_ReceiverSymbol;
 extern SEXP nano_ResolveSymbol;
 extern SEXP nano_ResponseSymbol;
 extern SEXP nano_ResultSymbol;
@@ -377,6 +625,7 @@ extern SEXP nano_StateSymbol;
 extern SEXP nano_StatusSymbol;
 extern SEXP nano_StreamSymbol;
 extern SEXP nano_ThreadSymbol;
+extern SEXP nano_TimerSymbol;
 extern SEXP nano_TlsSymbol;
 extern SEXP nano_UrlSymbol;
 extern SEXP nano_ValueSymbol;
@@ -387,6 +636,7 @@ extern SEXP nano_aioFuncMsg;
 extern SEXP nano_aioFuncRes;
 extern SEXP nano_aioNFuncs;
 extern SEXP nano_error;
+extern SEXP nano_liteAio;
 extern SEXP nano_precious;
 extern SEXP nano_recvAio;
 extern SEXP nano_reqAio;
@@ -421,8 +671,16 @@ static inline int nano_integer(const SEXP x) {
   return (TYPEOF(x) == INTSXP || TYPEOF(x) == LGLSXP) ? NANO_INTEGER(x) : Rf_asInteger(x);
 }
 
-static inline void later2(void (*fun)(void *), void *data) {
-  eln2(fun, data, 0, 0);
+#define NANO_CQ_PENDING -1
+#define NANO_CQ_DONE -2
+
+// must be entered under the lock of the owning condition variable - an Aio
+// completing before it is registered is queued by nano_cq_register() instead
+static inline void nano_cq_push(nano_cq *cq, int *qid) {
+  if (*qid >= 0)
+    cq->queue[(cq->head + cq->count++) % cq->size] = *qid;
+  else
+    *qid = NANO_CQ_DONE;
 }
 
 void dialer_finalizer(SEXP);
@@ -439,23 +697,47 @@ SEXP nano_unserialize(unsigned char *, const size_t, SEXP);
 SEXP nano_decode(unsigned char *, const size_t, const uint8_t, SEXP);
 SEXP nano_url_with_port(nng_url *, int);
 void nano_encode(nano_buf *, const SEXP);
+int nano_encode_iov(const nano_framer *, nng_iov *, unsigned char *, const SEXP);
+void nano_encode_typed(nano_buf *, const SEXP, size_t);
 int nano_encode_mode(const SEXP);
 uint8_t nano_matcharg(const SEXP);
 SEXP nano_aio_result(SEXP);
 SEXP nano_aio_get_msg(SEXP);
+SEXP nano_aio_lite_value(SEXP);
 SEXP nano_aio_http_status(SEXP);
+void nano_cq_ensure(SEXP);
+void nano_cq_register(SEXP, int *, SEXP);
+void nano_timer_detach(SEXP, void *);
+int nano_receiver_take(SEXP, nng_msg **, const int, const nng_duration);
+nano_framer *nano_framer_alloc(const nano_framing, const size_t);
+void nano_framer_release(nano_framer *);
+int nano_frame_take(nano_framer *, nng_msg **);
+int nano_frame_prep(nano_framer *, nng_aio *);
+int nano_frame_recv(nano_stream *, nng_msg **, const int, const nng_duration);
+unsigned char *nano_arena_take(nano_framer *, size_t *);
+void nano_arena_give(nano_framer *, const size_t);
+SEXP nano_arena_decode(void *);
+void nano_arena_cleanup(void *, Rboolean);
+size_t nano_frame_overhead(const nano_framer *);
+int nano_frame_check(const nano_framer *, const size_t);
+size_t nano_frame_header(const nano_framer *, unsigned char *, const size_t);
+void nano_frame_write(const nano_framer *, unsigned char *, const unsigned char *, const size_t);
 
 void pipe_cb_signal(nng_pipe, nng_pipe_ev, void *);
 void pipe_cb_monitor(nng_pipe, nng_pipe_ev, void *);
 void tls_finalizer(SEXP);
 
 void nano_load_later(void);
+void later2(void (*)(void *), void *);
 SEXP nano_findVarInFrame(const SEXP, const SEXP, int *);
 SEXP nano_PreserveObject(const SEXP);
 void nano_ReleaseObject(SEXP);
 
 void nano_list_do(nano_list_op, nano_aio *);
+nano_aio *nano_pool_get(const nano_pool_typ);
+void nano_pool_put(nano_aio *);
 void nano_thread_shutdown(void);
+void nano_wait_notify(void);
 int dispatch_cancel_direct(void *, int);
 
 SEXP rnng_advance_rng_state(void);
@@ -463,17 +745,23 @@ SEXP rnng_aio_call(SEXP);
 SEXP rnng_aio_collect(SEXP);
 SEXP rnng_aio_collect_safe(SEXP);
 SEXP rnng_aio_get_msg(SEXP);
+SEXP rnng_aio_lite(SEXP, SEXP);
+SEXP rnng_aio_pool(void);
 SEXP rnng_aio_http_data(SEXP);
 SEXP rnng_aio_http_headers(SEXP);
 SEXP rnng_aio_http_status(SEXP);
 SEXP rnng_aio_result(SEXP);
 SEXP rnng_aio_stop(SEXP);
+SEXP rnng_broker_aio(SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_broker_stats(SEXP);
 SEXP rnng_clock(void);
 SEXP rnng_close(SEXP);
 SEXP rnng_conn_close(SEXP);
 SEXP rnng_ctx_close(SEXP);
 SEXP rnng_ctx_create(SEXP);
 SEXP rnng_ctx_open(SEXP);
+SEXP rnng_cq_alloc(void);
+SEXP rnng_cq_next(SEXP, SEXP);
 SEXP rnng_cv_alloc(void);
 SEXP rnng_cv_reset(SEXP);
 SEXP rnng_cv_signal(SEXP);
@@ -504,6 +792,7 @@ SEXP rnng_http_server_stop(SEXP);
 SEXP rnng_ip_addr(void);
 SEXP rnng_is_error_value(SEXP);
 SEXP rnng_is_nul_byte(SEXP);
+SEXP rnng_later_latency(SEXP);
 SEXP rnng_listen(SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_listener_close(SEXP);
 SEXP rnng_listener_start(SEXP);
@@ -516,16 +805,25 @@ SEXP rnng_ncurl_session(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_ncurl_session_close(SEXP);
 SEXP rnng_ncurl_transact(SEXP);
 SEXP rnng_pipe_notify(SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_pipeline_aio(SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_pipeline_stats(SEXP);
 SEXP rnng_protocol_open(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_random(SEXP, SEXP);
 SEXP rnng_read_stdin(SEXP);
 SEXP rnng_reap(SEXP);
+SEXP rnng_receiver_close(SEXP);
+SEXP rnng_receiver_create(SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_recv(SEXP, SEXP, SEXP);
 SEXP rnng_recv_aio(SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_recv_batch(SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_recv_file(SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_recv_into(SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_request(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_request_stop(SEXP);
 SEXP rnng_send(SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_send_aio(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_send_batch_aio(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_send_file(SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_serial_config(SEXP, SEXP, SEXP);
 SEXP rnng_set_opt(SEXP, SEXP, SEXP);
 SEXP rnng_set_promise_context(SEXP, SEXP);
@@ -537,9 +835,16 @@ SEXP rnng_stream_close(SEXP);
 SEXP rnng_stream_conn_send(SEXP, SEXP);
 SEXP rnng_stream_conn_set_header(SEXP, SEXP, SEXP);
 SEXP rnng_stream_conn_set_status(SEXP, SEXP);
-SEXP rnng_stream_open(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_stream_open(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_strerror(SEXP);
 SEXP rnng_subscribe(SEXP, SEXP, SEXP);
+SEXP rnng_thread_info(void);
+SEXP rnng_threads(SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_timer_cancel(SEXP, SEXP);
+SEXP rnng_timer_send(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_timer_signal(SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_timer_timeout(SEXP, SEXP, SEXP);
+SEXP rnng_timer_wheel(SEXP, SEXP);
 SEXP rnng_tls_config(SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_traverse_precious(void);
 SEXP rnng_unresolved(SEXP);
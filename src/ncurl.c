@@ -134,6 +134,7 @@ static void haio_complete(void *arg) {
   nano_aio *haio = (nano_aio *) arg;
   const int res = nng_aio_result(haio->aio);
   haio->result = res - !res;
+  nano_wait_notify();
 
   if (haio->cb != NULL)
     later2(haio_invoke_cb, haio->cb);
@@ -145,6 +146,7 @@ static void session_complete(void *arg) {
   nano_aio *haio = (nano_aio *) arg;
   const int res = nng_aio_result(haio->aio);
   haio->result = res - !res;
+  nano_wait_notify();
 
 }
 
@@ -154,6 +156,7 @@ static void haio_finalizer(SEXP xptr) {
 
   if (NANO_PTR(xptr) == NULL) return;
   nano_aio *xp = (nano_aio *) NANO_PTR(xptr);
+  nano_timer_detach(xptr, xp->aio);
   nano_handle *handle = (nano_handle *) xp->next;
   nng_aio_free(xp->aio);
   if (handle->cfg != NULL)
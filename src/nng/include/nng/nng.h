@@ -344,6 +344,8 @@ NNG_DECL void nng_aio_reap(nng_aio *);
 
 NNG_DECL void nng_aio_stop(nng_aio *);
 
+NNG_DECL void nng_aio_reset(nng_aio *);
+
 NNG_DECL int nng_aio_result(nng_aio *);
 
 NNG_DECL size_t nng_aio_count(nng_aio *);
@@ -917,6 +919,25 @@ NNG_DECL int nng_ctx_set_addr(
 typedef int   nng_init_parameter;
 NNG_DECL void nng_init_set_parameter(nng_init_parameter, uint64_t);
 
+// nng_init_done returns true once the library has been initialized, after
+// which init parameters no longer have any effect.
+NNG_DECL bool nng_init_done(void);
+
+// nng_init_get_effective returns the value actually used for a thread count
+// parameter once the library has initialized, or (uint64_t) -1 if unknown.
+NNG_DECL uint64_t nng_init_get_effective(nng_init_parameter);
+
+// nng_init_set_affinity pins the threads of a pool, identified by its
+// NNG_INIT_NUM_*_THREADS parameter (task, expire or poller), to the given
+// CPUs.  A zero count clears it.  This must be called before the library
+// initializes, and is honored only on Linux and Windows.
+NNG_DECL int nng_init_set_affinity(nng_init_parameter, const int *, size_t);
+
+// nng_init_get_affinity retrieves the CPUs set for a pool, returning false
+// if none were set.
+NNG_DECL bool nng_init_get_affinity(
+    nng_init_parameter, const int **, size_t *);
+
 enum {
 	NNG_INIT_PARAMETER_NONE = 0,
 
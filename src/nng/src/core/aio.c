@@ -251,6 +251,38 @@ nni_aio_count(nni_aio *aio)
 	return (aio->a_count);
 }
 
+// nni_aio_reset stops any operation on the aio, as nni_aio_stop does, and
+// then returns it to its freshly allocated state so that it may be reused.
+// Unlike nni_aio_stop, the aio will accept new operations afterwards.
+// The callback and argument are retained.
+void
+nni_aio_reset(nni_aio *aio)
+{
+	nni_aio_expire_q *eq = aio->a_expire_q;
+
+	nni_aio_stop(aio);
+
+	nni_mtx_lock(&eq->eq_mtx);
+	for (unsigned i = 0; i < NNI_NUM_ELEMENTS(aio->a_inputs); i++) {
+		aio->a_inputs[i]  = NULL;
+		aio->a_outputs[i] = NULL;
+	}
+	aio->a_stop       = false;
+	aio->a_abort      = false;
+	aio->a_sleep      = false;
+	aio->a_expire_ok  = false;
+	aio->a_use_expire = false;
+	aio->a_result     = 0;
+	aio->a_count      = 0;
+	aio->a_nio        = 0;
+	aio->a_msg        = NULL;
+	aio->a_prov_data  = NULL;
+	aio->a_expire     = NNI_TIME_NEVER;
+	aio->a_timeout    = NNG_DURATION_INFINITE;
+	memset(aio->a_iov, 0, sizeof(aio->a_iov));
+	nni_mtx_unlock(&eq->eq_mtx);
+}
+
 void
 nni_aio_wait(nni_aio *aio)
 {
@@ -503,6 +535,7 @@ nni_aio_expire_loop(void *arg)
 	nni_aio          *expires[NNI_EXPIRE_BATCH];
 
 	nni_thr_set_name(NULL, "nng:aio:expire");
+	nni_thr_set_affinity(NULL, NNG_INIT_NUM_EXPIRE_THREADS);
 
 	nni_mtx_lock(mtx);
 
@@ -32,6 +32,9 @@ extern void nni_aio_free_cb(void *aio);
 
 extern void nni_aio_stop(nni_aio *);
 
+// nni_aio_reset stops the aio and reinitializes it for reuse.
+extern void nni_aio_reset(nni_aio *);
+
 extern void nni_aio_close(nni_aio *);
 
 extern void nni_aio_set_input(nni_aio *, unsigned, void *);
@@ -14,6 +14,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 extern int  nni_tls_sys_init(void);
 extern void nni_tls_sys_fini(void);
@@ -61,18 +62,32 @@ nni_init(void)
 	return (rv);
 }
 
+bool
+nni_init_done(void)
+{
+	return (nni_inited);
+}
+
 typedef struct nni_init_param {
 	nni_list_node      node;
 	nng_init_parameter param;
 	uint64_t           value;
-#ifdef NNG_TEST_LIB
-	uint64_t effective;
-#endif
+	uint64_t           effective;
 } nni_init_param;
 
 static nni_list nni_init_params =
     NNI_LIST_INITIALIZER(nni_init_params, nni_init_param, node);
 
+typedef struct nni_init_affinity {
+	nni_list_node      node;
+	nng_init_parameter param;
+	int               *cpus;
+	size_t             ncpu;
+} nni_init_affinity;
+
+static nni_list nni_init_affinities =
+    NNI_LIST_INITIALIZER(nni_init_affinities, nni_init_affinity, node);
+
 void
 nni_init_set_param(nng_init_parameter p, uint64_t value)
 {
@@ -87,8 +102,9 @@ nni_init_set_param(nng_init_parameter p, uint64_t value)
 		}
 	}
 	if ((item = NNI_ALLOC_STRUCT(item)) != NULL) {
-		item->param = p;
-		item->value = value;
+		item->param     = p;
+		item->value     = value;
+		item->effective = (uint64_t) -1;
 		nni_list_append(&nni_init_params, item);
 	}
 }
@@ -105,10 +121,12 @@ nni_init_get_param(nng_init_parameter p, uint64_t default_value)
 	return (default_value);
 }
 
+// Effective values are always recorded so that they can be reported.  Items
+// created here are never read by nni_init_get_param, as each parameter is
+// read before its effective value is set.
 void
 nni_init_set_effective(nng_init_parameter p, uint64_t value)
 {
-#ifdef NNG_TEST_LIB
 	nni_init_param *item;
 	NNI_LIST_FOREACH (&nni_init_params, item) {
 		if (item->param == p) {
@@ -121,13 +139,8 @@ nni_init_set_effective(nng_init_parameter p, uint64_t value)
 		item->effective = value;
 		nni_list_append(&nni_init_params, item);
 	}
-#else
-	NNI_ARG_UNUSED(p);
-	NNI_ARG_UNUSED(value);
-#endif
 }
 
-#ifdef NNG_TEST_LIB
 uint64_t
 nni_init_get_effective(nng_init_parameter p)
 {
@@ -139,16 +152,75 @@ nni_init_get_effective(nng_init_parameter p)
 	}
 	return ((uint64_t) -1);
 }
-#endif
+
+int
+nni_init_set_affinity(nng_init_parameter p, const int *cpus, size_t ncpu)
+{
+	nni_init_affinity *item;
+	int               *copy = NULL;
+
+	if (nni_inited) {
+		return (NNG_EBUSY);
+	}
+	if ((ncpu > 0) && ((copy = nni_alloc(ncpu * sizeof(int))) == NULL)) {
+		return (NNG_ENOMEM);
+	}
+	NNI_LIST_FOREACH (&nni_init_affinities, item) {
+		if (item->param == p) {
+			break;
+		}
+	}
+	if (item == NULL) {
+		if (ncpu == 0) {
+			return (0);
+		}
+		if ((item = NNI_ALLOC_STRUCT(item)) == NULL) {
+			nni_free(copy, ncpu * sizeof(int));
+			return (NNG_ENOMEM);
+		}
+		item->param = p;
+		nni_list_append(&nni_init_affinities, item);
+	} else if (item->ncpu > 0) {
+		nni_free(item->cpus, item->ncpu * sizeof(int));
+	}
+	if (ncpu > 0) {
+		memcpy(copy, cpus, ncpu * sizeof(int));
+	}
+	item->cpus = copy;
+	item->ncpu = ncpu;
+	return (0);
+}
+
+bool
+nni_init_get_affinity(nng_init_parameter p, const int **cpus, size_t *ncpu)
+{
+	nni_init_affinity *item;
+	NNI_LIST_FOREACH (&nni_init_affinities, item) {
+		if ((item->param == p) && (item->ncpu > 0)) {
+			*cpus = item->cpus;
+			*ncpu = item->ncpu;
+			return (true);
+		}
+	}
+	return (false);
+}
 
 static void
 nni_init_params_fini(void)
 {
-	nni_init_param *item;
+	nni_init_param    *item;
+	nni_init_affinity *aff;
 	while ((item = nni_list_first(&nni_init_params)) != NULL) {
 		nni_list_remove(&nni_init_params, item);
 		NNI_FREE_STRUCT(item);
 	}
+	while ((aff = nni_list_first(&nni_init_affinities)) != NULL) {
+		nni_list_remove(&nni_init_affinities, aff);
+		if (aff->ncpu > 0) {
+			nni_free(aff->cpus, aff->ncpu * sizeof(int));
+		}
+		NNI_FREE_STRUCT(aff);
+	}
 }
 
 void
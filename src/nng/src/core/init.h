@@ -17,10 +17,18 @@ int nni_init(void);
 
 void nni_fini(void);
 
+bool nni_init_done(void);
+
 void nni_init_set_param(nng_init_parameter, uint64_t value);
 
 uint64_t nni_init_get_param(nng_init_parameter parameter, uint64_t default_value);
 
 void nni_init_set_effective(nng_init_parameter p, uint64_t value);
 
+uint64_t nni_init_get_effective(nng_init_parameter p);
+
+int nni_init_set_affinity(nng_init_parameter, const int *, size_t);
+
+bool nni_init_get_affinity(nng_init_parameter, const int **, size_t *);
+
 #endif
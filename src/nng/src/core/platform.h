@@ -70,6 +70,10 @@ extern bool nni_plat_thr_is_self(nni_plat_thr *);
 
 extern void nni_plat_thr_set_name(nni_plat_thr *, const char *);
 
+// nni_plat_thr_set_affinity restricts a thread (the caller if NULL) to the
+// given CPUs, where the platform supports this, and otherwise does nothing.
+extern void nni_plat_thr_set_affinity(nni_plat_thr *, const int *, size_t);
+
 typedef struct nni_atomic_flag nni_atomic_flag;
 
 extern bool nni_atomic_flag_test_and_set(nni_atomic_flag *);
@@ -253,6 +257,17 @@ extern char *nni_plat_join_dir(const char *, const char *);
 
 extern const char *nni_plat_file_basename(const char *);
 
+#ifdef NNG_HAVE_SHM_OPEN
+// Shared memory segments.  nni_plat_shm_create creates a new, uniquely
+// named segment of the given size and maps it, returning the name in the
+// supplied buffer.  nni_plat_shm_open maps an existing segment by name and
+// unlinks the name, so that only the two parties hold references to it.
+extern int  nni_plat_shm_create(char *, size_t, size_t, void **);
+extern int  nni_plat_shm_open(const char *, size_t *, void **);
+extern void nni_plat_shm_unlink(const char *);
+extern void nni_plat_shm_unmap(void *, size_t);
+#endif
+
 #if defined(NNG_PLATFORM_POSIX)
 #include "platform/posix/posix_impl.h"
 #elif defined(NNG_PLATFORM_WINDOWS)
@@ -35,6 +35,7 @@ nni_taskq_thread(void *self)
 	nni_task      *task;
 
 	nni_thr_set_name(NULL, "nng:task");
+	nni_thr_set_affinity(NULL, NNG_INIT_NUM_TASK_THREADS);
 
 	nni_mtx_lock(&tq->tq_mtx);
 	for (;;) {
@@ -171,3 +171,15 @@ nni_thr_set_name(nni_thr *thr, const char *name)
 {
 	nni_plat_thr_set_name(thr != NULL ? &thr->thr : NULL, name);
 }
+
+void
+nni_thr_set_affinity(nni_thr *thr, nng_init_parameter pool)
+{
+	const int *cpus;
+	size_t     ncpu;
+
+	if (nni_init_get_affinity(pool, &cpus, &ncpu)) {
+		nni_plat_thr_set_affinity(
+		    thr != NULL ? &thr->thr : NULL, cpus, ncpu);
+	}
+}
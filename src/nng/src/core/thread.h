@@ -56,4 +56,8 @@ extern bool nni_thr_is_self(nni_thr *thr);
 
 extern void nni_thr_set_name(nni_thr *thr, const char *);
 
+// nni_thr_set_affinity applies the CPU affinity configured for a thread pool,
+// identified by its NNG_INIT_NUM_*_THREADS parameter, if one was set.
+extern void nni_thr_set_affinity(nni_thr *thr, nng_init_parameter);
+
 #endif
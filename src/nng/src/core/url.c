@@ -296,6 +296,7 @@ nni_url_parse(nni_url **urlp, const char *raw)
 	if ((strcmp(url->u_scheme, "ipc") == 0) ||
 	    (strcmp(url->u_scheme, "unix") == 0) ||
 	    (strcmp(url->u_scheme, "abstract") == 0) ||
+	    (strcmp(url->u_scheme, "shm") == 0) ||
 	    (strcmp(url->u_scheme, "inproc") == 0)) {
 		if ((url->u_path = nni_strdup(s)) == NULL) {
 			rv = NNG_ENOMEM;
@@ -465,7 +466,7 @@ nni_url_asprintf(char **str, const nni_url *url)
 	const char *hostcb = "";
 
 	if ((strcmp(scheme, "ipc") == 0) || (strcmp(scheme, "inproc") == 0) ||
-            (strcmp(scheme, "unix") == 0) ||
+            (strcmp(scheme, "unix") == 0) || (strcmp(scheme, "shm") == 0) ||
             (strcmp(scheme, "ipc+abstract") == 0) ||
 	    (strcmp(scheme, "unix+abstract") == 0)) {
 		return (nni_asprintf(str, "%s://%s", scheme, url->u_path));
@@ -1950,6 +1950,12 @@ nng_aio_stop(nng_aio *aio)
 	nni_aio_stop(aio);
 }
 
+void
+nng_aio_reset(nng_aio *aio)
+{
+	nni_aio_reset(aio);
+}
+
 void
 nng_aio_wait(nng_aio *aio)
 {
@@ -2090,6 +2096,30 @@ nng_init_set_parameter(nng_init_parameter p, uint64_t value)
 	nni_init_set_param(p, value);
 }
 
+bool
+nng_init_done(void)
+{
+	return (nni_init_done());
+}
+
+uint64_t
+nng_init_get_effective(nng_init_parameter p)
+{
+	return (nni_init_get_effective(p));
+}
+
+int
+nng_init_set_affinity(nng_init_parameter p, const int *cpus, size_t ncpu)
+{
+	return (nni_init_set_affinity(p, cpus, ncpu));
+}
+
+bool
+nng_init_get_affinity(nng_init_parameter p, const int **cpus, size_t *ncpu)
+{
+	return (nni_init_get_affinity(p, cpus, ncpu));
+}
+
 nng_time
 nng_clock(void)
 {
@@ -26,6 +26,10 @@
 #include <sys/file.h>
 #endif
 
+#ifdef NNG_HAVE_SHM_OPEN
+#include <sys/mman.h>
+#endif
+
 static int
 nni_plat_make_parent_dirs(const char *path)
 {
@@ -307,4 +311,103 @@ nni_plat_join_dir(const char *prefix, const char *suffix)
 	return (NULL);
 }
 
+#ifdef NNG_HAVE_SHM_OPEN
+int
+nni_plat_shm_create(char *name, size_t namesz, size_t size, void **addrp)
+{
+	int   fd;
+	void *addr;
+	int   rv;
+
+	for (int i = 0; i < 8; i++) {
+		(void) snprintf(name, namesz, "/nng-%08x%08x%08x",
+		    (unsigned) getpid(), nni_random(), nni_random());
+		if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) >=
+		    0) {
+			break;
+		}
+		if (errno != EEXIST) {
+			return (nni_plat_errno(errno));
+		}
+	}
+	if (fd < 0) {
+		return (NNG_EADDRINUSE);
+	}
+#ifdef NNG_HAVE_POSIX_FALLOCATE
+	// Reserve the pages up front.  A sparse segment on a nearly full
+	// /dev/shm would otherwise raise SIGBUS on first touch of the ring;
+	// failing here instead leaves the pipe sending inline.
+	while ((rv = posix_fallocate(fd, 0, (off_t) size)) == EINTR) {
+		continue;
+	}
+	if (rv != 0) {
+		rv = nni_plat_errno(rv);
+#else
+	if (ftruncate(fd, (off_t) size) != 0) {
+		rv = nni_plat_errno(errno);
+#endif
+		(void) close(fd);
+		(void) shm_unlink(name);
+		return (rv);
+	}
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		rv = nni_plat_errno(errno);
+		(void) close(fd);
+		(void) shm_unlink(name);
+		return (rv);
+	}
+	(void) close(fd);
+	*addrp = addr;
+	return (0);
+}
+
+int
+nni_plat_shm_open(const char *name, size_t *sizep, void **addrp)
+{
+	int         fd;
+	void       *addr;
+	struct stat st;
+	int         rv;
+
+	if ((fd = shm_open(name, O_RDWR, 0)) < 0) {
+		return (nni_plat_errno(errno));
+	}
+	// The creator keeps the segment alive until we have it mapped.
+	(void) shm_unlink(name);
+	if (fstat(fd, &st) != 0) {
+		rv = nni_plat_errno(errno);
+		(void) close(fd);
+		return (rv);
+	}
+	if (st.st_size <= 0) {
+		(void) close(fd);
+		return (NNG_EINVAL);
+	}
+	addr = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		rv = nni_plat_errno(errno);
+		(void) close(fd);
+		return (rv);
+	}
+	(void) close(fd);
+	*sizep = (size_t) st.st_size;
+	*addrp = addr;
+	return (0);
+}
+
+void
+nni_plat_shm_unlink(const char *name)
+{
+	(void) shm_unlink(name);
+}
+
+void
+nni_plat_shm_unmap(void *addr, size_t size)
+{
+	(void) munmap(addr, size);
+}
+#endif
+
 #endif
@@ -59,7 +59,10 @@ struct nni_posix_pfd {
 	nni_cv           cv;
 };
 
-static nni_posix_pollq nni_posix_global_pollq;
+// There is one pollq (epoll instance and thread) per poller thread, and
+// each file descriptor is assigned to one of them when its pfd is created.
+static nni_posix_pollq *nni_posix_pollqs;
+static int              nni_posix_npollq;
 
 int
 nni_posix_pfd_init(nni_posix_pfd **pfdp, int fd)
@@ -69,7 +72,7 @@ nni_posix_pfd_init(nni_posix_pfd **pfdp, int fd)
 	struct epoll_event ev;
 	int                rv;
 
-	pq = &nni_posix_global_pollq;
+	pq = &nni_posix_pollqs[fd % nni_posix_npollq];
 
 	(void) fcntl(fd, F_SETFD, FD_CLOEXEC);
 	(void) fcntl(fd, F_SETFL, O_NONBLOCK);
@@ -344,6 +347,7 @@ nni_posix_pollq_create(nni_posix_pollq *pq)
 		return (rv);
 	}
 	nni_thr_set_name(&pq->thr, "nng:poll:epoll");
+	nni_thr_set_affinity(&pq->thr, NNG_INIT_NUM_POLLER_THREADS);
 	nni_thr_run(&pq->thr);
 	return (0);
 }
@@ -351,13 +355,61 @@ nni_posix_pollq_create(nni_posix_pollq *pq)
 int
 nni_posix_pollq_sysinit(void)
 {
-	return (nni_posix_pollq_create(&nni_posix_global_pollq));
+	int num_thr;
+	int max_thr;
+	int rv;
+
+#ifndef NNG_MAX_POLLER_THREADS
+#define NNG_MAX_POLLER_THREADS 8
+#endif
+// A single poller unless more are asked for, so that no extra threads are
+// started by default.
+#ifndef NNG_NUM_POLLER_THREADS
+#define NNG_NUM_POLLER_THREADS 1
+#endif
+	max_thr = (int) nni_init_get_param(
+	    NNG_INIT_MAX_POLLER_THREADS, NNG_MAX_POLLER_THREADS);
+
+	num_thr = (int) nni_init_get_param(
+	    NNG_INIT_NUM_POLLER_THREADS, NNG_NUM_POLLER_THREADS);
+
+	if ((max_thr > 0) && (num_thr > max_thr)) {
+		num_thr = max_thr;
+	}
+	if (num_thr < 1) {
+		num_thr = 1;
+	}
+	nni_init_set_effective(NNG_INIT_NUM_POLLER_THREADS, num_thr);
+
+	nni_posix_pollqs = NNI_ALLOC_STRUCTS(nni_posix_pollqs, num_thr);
+	if (nni_posix_pollqs == NULL) {
+		return (NNG_ENOMEM);
+	}
+	for (int i = 0; i < num_thr; i++) {
+		if ((rv = nni_posix_pollq_create(&nni_posix_pollqs[i])) != 0) {
+			while (--i >= 0) {
+				nni_posix_pollq_destroy(&nni_posix_pollqs[i]);
+			}
+			NNI_FREE_STRUCTS(nni_posix_pollqs, num_thr);
+			nni_posix_pollqs = NULL;
+			return (rv);
+		}
+	}
+	nni_posix_npollq = num_thr;
+	return (0);
 }
 
 void
 nni_posix_pollq_sysfini(void)
 {
-	nni_posix_pollq_destroy(&nni_posix_global_pollq);
+	for (int i = 0; i < nni_posix_npollq; i++) {
+		nni_posix_pollq_destroy(&nni_posix_pollqs[i]);
+	}
+	if (nni_posix_pollqs != NULL) {
+		NNI_FREE_STRUCTS(nni_posix_pollqs, nni_posix_npollq);
+		nni_posix_pollqs = NULL;
+	}
+	nni_posix_npollq = 0;
 }
 
 #endif
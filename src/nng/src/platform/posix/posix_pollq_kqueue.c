@@ -214,6 +214,7 @@ nni_posix_poll_thr(void *arg)
 	nni_posix_pollq *pq = arg;
 
 	nni_thr_set_name(NULL, "nng:poll:kqueue");
+	nni_thr_set_affinity(NULL, NNG_INIT_NUM_POLLER_THREADS);
 
 	for (;;) {
 		int              n;
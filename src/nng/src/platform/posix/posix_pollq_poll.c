@@ -281,6 +281,7 @@ nni_posix_pollq_create(nni_posix_pollq *pq)
 		return (rv);
 	}
 	nni_thr_set_name(&pq->thr, "nng:poll:poll");
+	nni_thr_set_affinity(&pq->thr, NNG_INIT_NUM_POLLER_THREADS);
 	nni_mtx_init(&pq->mtx);
 	nni_thr_run(&pq->thr);
 	return (0);
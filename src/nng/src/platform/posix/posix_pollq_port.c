@@ -211,6 +211,7 @@ nni_posix_pollq_create(nni_posix_pollq *pq)
 		return (rv);
 	}
 	nni_thr_set_name(&pq->thr, "nng:poll:port");
+	nni_thr_set_affinity(&pq->thr, NNG_INIT_NUM_POLLER_THREADS);
 
 	nni_thr_run(&pq->thr);
 	return (0);
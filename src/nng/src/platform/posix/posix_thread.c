@@ -269,6 +269,39 @@ nni_plat_thr_is_self(nni_plat_thr *thr)
 	return (pthread_self() == thr->tid);
 }
 
+void
+nni_plat_thr_set_affinity(nni_plat_thr *thr, const int *cpus, size_t ncpu)
+{
+#if defined(NNG_PLATFORM_LINUX) && defined(CPU_ALLOC)
+	pthread_t  tid = thr != NULL ? thr->tid : pthread_self();
+	cpu_set_t *set;
+	size_t     sz;
+	int        max = 0;
+
+	for (size_t i = 0; i < ncpu; i++) {
+		if (cpus[i] > max) {
+			max = cpus[i];
+		}
+	}
+	if ((set = CPU_ALLOC(max + 1)) == NULL) {
+		return;
+	}
+	sz = CPU_ALLOC_SIZE(max + 1);
+	CPU_ZERO_S(sz, set);
+	for (size_t i = 0; i < ncpu; i++) {
+		if (cpus[i] >= 0) {
+			CPU_SET_S(cpus[i], sz, set);
+		}
+	}
+	(void) pthread_setaffinity_np(tid, sz, set);
+	CPU_FREE(set);
+#else
+	NNI_ARG_UNUSED(thr);
+	NNI_ARG_UNUSED(cpus);
+	NNI_ARG_UNUSED(ncpu);
+#endif
+}
+
 void
 nni_plat_thr_set_name(nni_plat_thr *thr, const char *name)
 {
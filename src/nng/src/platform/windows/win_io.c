@@ -109,6 +109,8 @@ nni_win_io_sysinit(void)
 			goto fail;
 		}
 		nni_thr_set_name(&win_io_thrs[i], "nng:iocp");
+		nni_thr_set_affinity(
+		    &win_io_thrs[i], NNG_INIT_NUM_POLLER_THREADS);
 	}
 	for (i = 0; i < win_io_nthr; i++) {
 		nni_thr_run(&win_io_thrs[i]);
@@ -384,6 +384,22 @@ nni_plat_thr_is_self(nni_plat_thr *thr)
 	return (GetCurrentThreadId() == thr->id);
 }
 
+void
+nni_plat_thr_set_affinity(nni_plat_thr *thr, const int *cpus, size_t ncpu)
+{
+	DWORD_PTR mask = 0;
+
+	for (size_t i = 0; i < ncpu; i++) {
+		if ((cpus[i] >= 0) && (cpus[i] < (int) (sizeof(mask) * 8))) {
+			mask |= ((DWORD_PTR) 1) << cpus[i];
+		}
+	}
+	if (mask != 0) {
+		(void) SetThreadAffinityMask(
+		    thr != NULL ? thr->handle : GetCurrentThread(), mask);
+	}
+}
+
 void
 nni_plat_thr_set_name(nni_plat_thr *thr, const char *name)
 {
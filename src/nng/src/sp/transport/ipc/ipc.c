@@ -10,6 +10,7 @@
 //
 
 #include <stdio.h>
+#include <string.h>
 
 #include "core/nng_impl.h"
 
@@ -18,6 +19,20 @@
 typedef struct ipc_pipe ipc_pipe;
 typedef struct ipc_ep   ipc_ep;
 
+// The shm transport is the IPC transport with a pair of shared memory rings
+// alongside the connection.  Each side creates a ring it writes to, and sends
+// its name during negotiation.  Messages of at least NNG_SHM_MIN_MSG bytes
+// are copied into the ring, and only their position is sent over the
+// connection.  The first IPC_SHM_HDR bytes of a ring hold the reader's tail.
+#ifndef NNG_SHM_RING_SIZE
+#define NNG_SHM_RING_SIZE (16 * 1024 * 1024)
+#endif
+#ifndef NNG_SHM_MIN_MSG
+#define NNG_SHM_MIN_MSG 65536
+#endif
+#define IPC_SHM_HDR 64
+#define IPC_SHM_NAME 32
+
 struct ipc_pipe {
 	nng_stream     *conn;
 	uint16_t        peer;
@@ -29,8 +44,8 @@ struct ipc_pipe {
 	nni_list_node   node;
 	nni_atomic_flag reaped;
 	nni_reap_node   reap;
-	uint8_t         tx_head[1 + sizeof(uint64_t)];
-	uint8_t         rx_head[1 + sizeof(uint64_t)];
+	uint8_t         tx_head[8 + IPC_SHM_NAME];
+	uint8_t         rx_head[8 + IPC_SHM_NAME];
 	size_t          got_tx_head;
 	size_t          got_rx_head;
 	size_t          want_tx_head;
@@ -42,6 +57,13 @@ struct ipc_pipe {
 	nni_aio         neg_aio;
 	nni_msg        *rx_msg;
 	nni_mtx         mtx;
+	char            shm_name[IPC_SHM_NAME];
+	uint8_t        *tx_ring;
+	size_t          tx_ring_sz;
+	uint64_t        tx_pos;
+	uint8_t        *rx_ring;
+	size_t          rx_ring_sz;
+	bool            rx_shm;
 };
 
 struct ipc_ep {
@@ -51,6 +73,7 @@ struct ipc_ep {
 	bool                 started;
 	bool                 closed;
 	bool                 fini;
+	bool                 shm;
 	int                  ref_cnt;
 	nng_stream_dialer   *dialer;
 	nng_stream_listener *listener;
@@ -94,6 +117,144 @@ ipc_tran_fini(void)
 {
 }
 
+static void
+ipc_pipe_shm_create(ipc_pipe *p)
+{
+#ifdef NNG_HAVE_SHM_OPEN
+	void *addr;
+
+	if (nni_plat_shm_create(p->shm_name, sizeof(p->shm_name),
+	        NNG_SHM_RING_SIZE, &addr) == 0) {
+		p->tx_ring    = addr;
+		p->tx_ring_sz = NNG_SHM_RING_SIZE;
+		p->tx_pos     = 0;
+		return;
+	}
+#endif
+	// Without a ring of our own, every message we send goes inline.
+	p->shm_name[0] = '\0';
+}
+
+static int
+ipc_pipe_shm_open(ipc_pipe *p, const uint8_t *buf)
+{
+	char name[IPC_SHM_NAME + 1];
+
+	memcpy(name, buf, IPC_SHM_NAME);
+	name[IPC_SHM_NAME] = '\0';
+	if (name[0] == '\0') {
+		return (0);
+	}
+	// Only accept names of the form we generate, as we unlink it.
+	if (strncmp(name, "/nng-", 5) != 0) {
+		return (NNG_EPROTO);
+	}
+	for (size_t i = 5; name[i] != '\0'; i++) {
+		if (!(((name[i] >= '0') && (name[i] <= '9')) ||
+		        ((name[i] >= 'a') && (name[i] <= 'f')))) {
+			return (NNG_EPROTO);
+		}
+	}
+#ifdef NNG_HAVE_SHM_OPEN
+	void  *addr;
+	size_t sz;
+	int    rv;
+
+	if ((rv = nni_plat_shm_open(name, &sz, &addr)) != 0) {
+		return (rv);
+	}
+	if (sz <= IPC_SHM_HDR) {
+		nni_plat_shm_unmap(addr, sz);
+		return (NNG_EPROTO);
+	}
+	p->rx_ring    = addr;
+	p->rx_ring_sz = sz;
+	return (0);
+#else
+	NNI_ARG_UNUSED(p);
+	return (NNG_ENOTSUP);
+#endif
+}
+
+static void
+ipc_pipe_shm_fini(ipc_pipe *p)
+{
+#ifdef NNG_HAVE_SHM_OPEN
+	if (p->tx_ring != NULL) {
+		// Normally the peer unlinked this when it mapped the ring.
+		nni_plat_shm_unlink(p->shm_name);
+		nni_plat_shm_unmap(p->tx_ring, p->tx_ring_sz);
+	}
+	if (p->rx_ring != NULL) {
+		nni_plat_shm_unmap(p->rx_ring, p->rx_ring_sz);
+	}
+#else
+	NNI_ARG_UNUSED(p);
+#endif
+}
+
+// ipc_pipe_shm_put copies the message into the transmit ring, and records
+// its position in the frame header.  It returns false if the message should
+// be sent inline instead, because it is small or the ring lacks space.
+static bool
+ipc_pipe_shm_put(ipc_pipe *p, nni_msg *msg, uint64_t len)
+{
+	uint64_t size;
+	uint64_t pos;
+	uint64_t off;
+	uint64_t tail;
+	uint8_t *data;
+
+	if ((p->tx_ring == NULL) || (len < NNG_SHM_MIN_MSG)) {
+		return (false);
+	}
+	size = p->tx_ring_sz - IPC_SHM_HDR;
+	if (len > size) {
+		return (false);
+	}
+	// Messages are never split; skip to the start if this one would wrap.
+	pos = p->tx_pos;
+	off = pos % size;
+	if (off + len > size) {
+		pos += size - off;
+		off = 0;
+	}
+	tail = __atomic_load_n((uint64_t *) (void *) p->tx_ring,
+	    __ATOMIC_ACQUIRE);
+	if (pos + len - tail > size) {
+		return (false);
+	}
+	data = p->tx_ring + IPC_SHM_HDR + off;
+	memcpy(data, nni_msg_header(msg), nni_msg_header_len(msg));
+	memcpy(data + nni_msg_header_len(msg), nni_msg_body(msg),
+	    nni_msg_len(msg));
+	NNI_PUT64(p->tx_head + 1 + sizeof(uint64_t), pos);
+	p->tx_pos = pos + len;
+	return (true);
+}
+
+static int
+ipc_pipe_shm_get(ipc_pipe *p, uint64_t pos, uint64_t len)
+{
+	uint64_t size;
+	uint64_t off;
+
+	if (p->rx_ring == NULL) {
+		return (NNG_EPROTO);
+	}
+	size = p->rx_ring_sz - IPC_SHM_HDR;
+	off  = pos % size;
+	if ((len > size) || (off + len > size)) {
+		return (NNG_EPROTO);
+	}
+	memcpy(nni_msg_body(p->rx_msg), p->rx_ring + IPC_SHM_HDR + off,
+	    (size_t) len);
+	// Hand the space back to the writer.
+	__atomic_store_n(
+	    (uint64_t *) (void *) p->rx_ring, pos + len, __ATOMIC_RELEASE);
+	return (0);
+}
+
 static void
 ipc_pipe_close(void *arg)
 {
@@ -151,6 +312,7 @@ ipc_pipe_fini(void *arg)
 	if (p->rx_msg) {
 		nni_msg_free(p->rx_msg);
 	}
+	ipc_pipe_shm_fini(p);
 	nni_mtx_fini(&p->mtx);
 	NNI_FREE_STRUCT(p);
 }
@@ -246,6 +408,10 @@ ipc_pipe_nego_cb(void *arg)
 
 	NNI_GET16(&p->rx_head[4], p->peer);
 
+	if (ep->shm && ((rv = ipc_pipe_shm_open(p, &p->rx_head[8])) != 0)) {
+		goto error;
+	}
+
 	nni_list_remove(&ep->nego_pipes, p);
 	nni_list_append(&ep->wait_pipes, p);
 
@@ -338,7 +504,20 @@ ipc_pipe_recv_cb(void *arg)
 	if (p->rx_msg == NULL) {
 		uint64_t len;
 
-		if (p->rx_head[0] != 1) {
+		if ((p->rx_head[0] == 2) && (p->rx_ring != NULL) &&
+		    (!p->rx_shm)) {
+			// Shared memory frames also carry the ring position.
+			nni_iov iov;
+			p->rx_shm   = true;
+			iov.iov_buf = p->rx_head + 1 + sizeof(uint64_t);
+			iov.iov_len = sizeof(uint64_t);
+
+			nni_aio_set_iov(rx_aio, 1, &iov);
+			nng_stream_recv(p->conn, rx_aio);
+			nni_mtx_unlock(&p->mtx);
+			return;
+		}
+		if (p->rx_head[0] != (p->rx_shm ? 2 : 1)) {
 			rv = NNG_EPROTO;
 			goto error;
 		}
@@ -367,7 +546,13 @@ ipc_pipe_recv_cb(void *arg)
 			goto error;
 		}
 
-		if (len != 0) {
+		if (p->rx_shm) {
+			uint64_t pos;
+			NNI_GET64(p->rx_head + 1 + sizeof(uint64_t), pos);
+			if ((rv = ipc_pipe_shm_get(p, pos, len)) != 0) {
+				goto error;
+			}
+		} else if (len != 0) {
 			nni_iov iov;
 			iov.iov_buf = nni_msg_body(p->rx_msg);
 			iov.iov_len = (size_t) len;
@@ -449,13 +634,20 @@ ipc_pipe_send_start(ipc_pipe *p)
 	msg = nni_aio_get_msg(aio);
 	len = nni_msg_len(msg) + nni_msg_header_len(msg);
 
-	p->tx_head[0] = 1;
 	NNI_PUT64(p->tx_head + 1, len);
 
 	nio            = 0;
 	iov[0].iov_buf = p->tx_head;
-	iov[0].iov_len = sizeof(p->tx_head);
+	iov[0].iov_len = 1 + sizeof(uint64_t);
 	nio++;
+	if (ipc_pipe_shm_put(p, msg, len)) {
+		p->tx_head[0] = 2;
+		iov[0].iov_len += sizeof(uint64_t);
+		nni_aio_set_iov(&p->tx_aio, nio, iov);
+		nng_stream_send(p->conn, &p->tx_aio);
+		return;
+	}
+	p->tx_head[0] = 1;
 	if (nni_msg_header_len(msg) > 0) {
 		iov[nio].iov_buf = nni_msg_header(msg);
 		iov[nio].iov_len = nni_msg_header_len(msg);
@@ -532,8 +724,9 @@ ipc_pipe_recv_start(ipc_pipe *p)
 		return;
 	}
 
+	p->rx_shm   = false;
 	iov.iov_buf = p->rx_head;
-	iov.iov_len = sizeof(p->rx_head);
+	iov.iov_len = 1 + sizeof(uint64_t);
 	nni_aio_set_iov(&p->rx_aio, 1, &iov);
 
 	nng_stream_recv(p->conn, &p->rx_aio);
@@ -597,8 +790,14 @@ ipc_pipe_start(ipc_pipe *p, nng_stream *conn, ipc_ep *ep)
 	p->got_tx_head  = 0;
 	p->want_rx_head = 8;
 	p->want_tx_head = 8;
-	iov.iov_len     = 8;
-	iov.iov_buf     = &p->tx_head[0];
+	if (ep->shm) {
+		ipc_pipe_shm_create(p);
+		memcpy(&p->tx_head[8], p->shm_name, IPC_SHM_NAME);
+		p->want_rx_head += IPC_SHM_NAME;
+		p->want_tx_head += IPC_SHM_NAME;
+	}
+	iov.iov_len = p->want_tx_head;
+	iov.iov_buf = &p->tx_head[0];
 	nni_aio_set_iov(&p->neg_aio, 1, &iov);
 	nni_list_append(&ep->nego_pipes, p);
 
@@ -803,8 +1002,18 @@ ipc_ep_init_dialer(void **dp, nni_url *url, nni_dialer *dialer)
 		return (rv);
 	}
 
-	if (((rv = nni_aio_alloc(&ep->conn_aio, ipc_ep_dial_cb, ep)) != 0) ||
-	    ((rv = nng_stream_dialer_alloc_url(&ep->dialer, url)) != 0)) {
+	if (strcmp(url->u_scheme, "shm") == 0) {
+		char *path;
+		ep->shm = true;
+		if ((rv = nni_asprintf(&path, "ipc://%s", url->u_path)) == 0) {
+			rv = nng_stream_dialer_alloc(&ep->dialer, path);
+			nni_strfree(path);
+		}
+	} else {
+		rv = nng_stream_dialer_alloc_url(&ep->dialer, url);
+	}
+	if ((rv != 0) ||
+	    ((rv = nni_aio_alloc(&ep->conn_aio, ipc_ep_dial_cb, ep)) != 0)) {
 		ipc_ep_fini(ep);
 		return (rv);
 	}
@@ -826,9 +1035,19 @@ ipc_ep_init_listener(void **dp, nni_url *url, nni_listener *listener)
 		return (rv);
 	}
 
-	if (((rv = nni_aio_alloc(&ep->conn_aio, ipc_ep_accept_cb, ep)) != 0) ||
-	    ((rv = nni_aio_alloc(&ep->time_aio, ipc_ep_timer_cb, ep)) != 0) ||
-	    ((rv = nng_stream_listener_alloc_url(&ep->listener, url)) != 0)) {
+	if (strcmp(url->u_scheme, "shm") == 0) {
+		char *path;
+		ep->shm = true;
+		if ((rv = nni_asprintf(&path, "ipc://%s", url->u_path)) == 0) {
+			rv = nng_stream_listener_alloc(&ep->listener, path);
+			nni_strfree(path);
+		}
+	} else {
+		rv = nng_stream_listener_alloc_url(&ep->listener, url);
+	}
+	if ((rv != 0) ||
+	    ((rv = nni_aio_alloc(&ep->conn_aio, ipc_ep_accept_cb, ep)) != 0) ||
+	    ((rv = nni_aio_alloc(&ep->time_aio, ipc_ep_timer_cb, ep)) != 0)) {
 		ipc_ep_fini(ep);
 		return (rv);
 	}
@@ -1095,6 +1314,17 @@ static nni_sp_tran ipc_tran_abstract = {
 };
 #endif
 
+#ifdef NNG_HAVE_SHM_OPEN
+static nni_sp_tran ipc_tran_shm = {
+	.tran_scheme   = "shm",
+	.tran_dialer   = &ipc_dialer_ops,
+	.tran_listener = &ipc_listener_ops,
+	.tran_pipe     = &ipc_tran_pipe_ops,
+	.tran_init     = ipc_tran_init,
+	.tran_fini     = ipc_tran_fini,
+};
+#endif
+
 #ifndef NNG_ELIDE_DEPRECATED
 int
 nng_ipc_register(void)
@@ -1113,4 +1343,7 @@ nni_sp_ipc_register(void)
 #ifdef NNG_HAVE_ABSTRACT_SOCKETS
 	nni_sp_tran_register(&ipc_tran_abstract);
 #endif
+#ifdef NNG_HAVE_SHM_OPEN
+	nni_sp_tran_register(&ipc_tran_shm);
+#endif
 }
@@ -9,6 +9,12 @@ static void stream_finalizer(SEXP xptr) {
 
   if (NANO_PTR(xptr) == NULL) return;
   nano_stream *xp = (nano_stream *) NANO_PTR(xptr);
+  nano_framer *rb = xp->frm != NULL ? xp->frm : xp->arena;
+  if (rb != NULL) {
+    nng_mtx_lock(rb->mtx);
+    rb->closed = 1;
+    nng_mtx_unlock(rb->mtx);
+  }
   nng_stream_close(xp->stream);
   nng_stream_free(xp->stream);
   if (xp->mode == NANO_STREAM_LISTENER) {
@@ -20,6 +26,9 @@ static void stream_finalizer(SEXP xptr) {
   }
   if (xp->tls != NULL)
     nng_tls_config_free(xp->tls);
+  if (rb != NULL)
+    nano_framer_release(rb);
+  nng_aio_free(xp->sync.aio);
   free(xp);
 
 }
@@ -36,7 +45,7 @@ SEXP rnng_protocol_open(SEXP protocol, SEXP dial, SEXP listen, SEXP tls, SEXP au
   int xc;
   SEXP socket;
 
-  nng_socket *sock = malloc(sizeof(nng_socket));
+  nng_socket *sock = calloc(1, sizeof(nano_sockctx));
   NANO_ENSURE_ALLOC(sock);
 
   switch (slen) {
@@ -194,10 +203,45 @@ SEXP rnng_reap(SEXP con) {
 
 // streams ---------------------------------------------------------------------
 
-static SEXP nano_stream_dial(SEXP url, SEXP textframes, SEXP headers, SEXP tls, SEXP buffer) {
+static nano_framing nano_framing_mode(SEXP framing, const char *url, size_t *max) {
+
+  if (framing == R_NilValue)
+    return NANO_FRAME_NONE;
+  if (!strncmp(url, "ws://", 5) || !strncmp(url, "wss://", 6))
+    Rf_error("`framing` is not supported for websocket streams");
+
+  if (TYPEOF(framing) == STRSXP) {
+    const char *mod = CHAR(STRING_ELT(framing, 0));
+    const size_t slen = strlen(mod);
+    switch (slen) {
+    case 3:
+      if (!memcmp(mod, "u32", slen)) return NANO_FRAME_U32;
+      if (!memcmp(mod, "u64", slen)) return NANO_FRAME_U64;
+      break;
+    case 4:
+      if (!memcmp(mod, "crlf", slen)) return NANO_FRAME_CRLF;
+      break;
+    case 7:
+      if (!memcmp(mod, "newline", slen)) return NANO_FRAME_LF;
+      break;
+    }
+  } else {
+    const int record = nano_integer(framing);
+    if (record > 0) {
+      *max = (size_t) record;
+      return NANO_FRAME_FIXED;
+    }
+  }
+
+  Rf_error("`framing` should be one of: u32, u64, newline, crlf, or a positive integer");
+
+}
+
+static SEXP nano_stream_dial(SEXP url, SEXP textframes, SEXP headers, SEXP tls, SEXP buffer, SEXP framing) {
 
   const char *add = CHAR(STRING_ELT(url, 0));
-  const size_t bufsize = (size_t) nano_integer(buffer);
+  size_t bufsize = (size_t) nano_integer(buffer);
+  const nano_framing frm = nano_framing_mode(framing, add, &bufsize);
   if (tls != R_NilValue && NANO_PTR_CHECK(tls, nano_TlsSymbol))
     Rf_error("`tls` is not a valid TLS Configuration");
 
@@ -270,6 +314,21 @@ static SEXP nano_stream_dial(SEXP url, SEXP textframes, SEXP headers, SEXP tls,
     goto fail;
 
   nst->stream = nng_aio_get_output(aiop, 0);
+  if (!nst->msgmode) {
+    nano_framer *rb = nano_framer_alloc(frm, bufsize);
+    if (rb == NULL) {
+      nng_stream_close(nst->stream);
+      nng_stream_free(nst->stream);
+      xc = NNG_ENOMEM;
+      goto fail;
+    }
+    rb->stream = nst->stream;
+    if (frm != NANO_FRAME_NONE) {
+      nst->frm = rb;
+    } else {
+      nst->arena = rb;
+    }
+  }
 
   nng_aio_free(aiop);
   nng_url_free(up);
@@ -297,10 +356,11 @@ static SEXP nano_stream_dial(SEXP url, SEXP textframes, SEXP headers, SEXP tls,
 
 }
 
-static SEXP nano_stream_listen(SEXP url, SEXP textframes, SEXP tls, SEXP buffer) {
+static SEXP nano_stream_listen(SEXP url, SEXP textframes, SEXP tls, SEXP buffer, SEXP framing) {
 
   const char *add = CHAR(STRING_ELT(url, 0));
-  const size_t bufsize = (size_t) nano_integer(buffer);
+  size_t bufsize = (size_t) nano_integer(buffer);
+  const nano_framing frm = nano_framing_mode(framing, add, &bufsize);
   if (tls != R_NilValue && NANO_PTR_CHECK(tls, nano_TlsSymbol))
     Rf_error("`tls` is not a valid TLS Configuration");
 
@@ -360,6 +420,21 @@ static SEXP nano_stream_listen(SEXP url, SEXP textframes, SEXP tls, SEXP buffer)
     goto fail;
 
   nst->stream = nng_aio_get_output(aiop, 0);
+  if (!nst->msgmode) {
+    nano_framer *rb = nano_framer_alloc(frm, bufsize);
+    if (rb == NULL) {
+      nng_stream_close(nst->stream);
+      nng_stream_free(nst->stream);
+      xc = NNG_ENOMEM;
+      goto fail;
+    }
+    rb->stream = nst->stream;
+    if (frm != NANO_FRAME_NONE) {
+      nst->frm = rb;
+    } else {
+      nst->arena = rb;
+    }
+  }
   
   nng_aio_free(aiop);
   nng_url_free(up);
@@ -387,12 +462,12 @@ static SEXP nano_stream_listen(SEXP url, SEXP textframes, SEXP tls, SEXP buffer)
 
 }
 
-SEXP rnng_stream_open(SEXP dial, SEXP listen, SEXP textframes, SEXP headers, SEXP tls, SEXP buffer) {
+SEXP rnng_stream_open(SEXP dial, SEXP listen, SEXP textframes, SEXP headers, SEXP tls, SEXP buffer, SEXP framing) {
 
   if (dial != R_NilValue) {
-    return nano_stream_dial(dial, textframes, headers, tls, buffer);
+    return nano_stream_dial(dial, textframes, headers, tls, buffer, framing);
   } else if (listen != R_NilValue) {
-    return nano_stream_listen(listen, textframes, tls, buffer);
+    return nano_stream_listen(listen, textframes, tls, buffer, framing);
   }
   Rf_error("specify a URL for either `dial` or `listen`");
 
@@ -2,6 +2,7 @@
 
 #define NANONEXT_SIGNALS
 #include "nanonext.h"
+#include <stdatomic.h>
 
 // internals -------------------------------------------------------------------
 
@@ -40,6 +41,104 @@ void nano_ReleaseObject(SEXP node) {
 
 }
 
+// coalesced callback delivery -------------------------------------------------
+
+// Callbacks scheduled from NNG threads are pushed onto a lock-free list, and
+// only the push that finds the list empty schedules a 'later' task, which then
+// runs every callback accumulated by the time it executes. The task is
+// delayed by the batch latency, bounding how long a callback may be held.
+
+typedef struct nano_later_s {
+  void (*fun)(void *);
+  void *data;
+  struct nano_later_s *next;
+} nano_later;
+
+static _Atomic(nano_later *) later_head = NULL;
+static atomic_int later_latency = 0;
+static nano_later *later_run = NULL;
+
+static void later_drain(void *);
+
+static SEXP later_run_all(void *arg) {
+
+  while (later_run != NULL) {
+    nano_later *node = later_run;
+    later_run = node->next;
+    void (*fun)(void *) = node->fun;
+    void *data = node->data;
+    free(node);
+    fun(data);
+  }
+  return R_NilValue;
+
+}
+
+static void later_cleanup(void *arg, Rboolean jump) {
+
+  // a callback errored: the remainder of the batch runs in a fresh task
+  if (jump && later_run != NULL)
+    eln2(later_drain, NULL, 0, 0);
+
+}
+
+static void later_drain(void *arg) {
+
+  nano_later *list = atomic_exchange_explicit(&later_head, NULL, memory_order_acquire);
+  nano_later *rev = NULL;
+  while (list != NULL) {
+    nano_later *next = list->next;
+    list->next = rev;
+    rev = list;
+    list = next;
+  }
+  if (later_run == NULL) {
+    later_run = rev;
+  } else {
+    nano_later *tail = later_run;
+    while (tail->next != NULL)
+      tail = tail->next;
+    tail->next = rev;
+  }
+
+  R_UnwindProtect(later_run_all, NULL, later_cleanup, NULL, NULL);
+
+}
+
+void later2(void (*fun)(void *), void *data) {
+
+  nano_later *node = malloc(sizeof(nano_later));
+  if (node == NULL) {
+    eln2(fun, data, 0, 0);
+    return;
+  }
+  node->fun = fun;
+  node->data = data;
+
+  nano_later *head = atomic_load_explicit(&later_head, memory_order_relaxed);
+  do {
+    node->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(&later_head, &head, node, memory_order_release, memory_order_relaxed));
+
+  if (head == NULL)
+    eln2(later_drain, NULL, atomic_load_explicit(&later_latency, memory_order_relaxed) / 1000.0, 0);
+
+}
+
+SEXP rnng_later_latency(SEXP time) {
+
+  const int prev = atomic_load(&later_latency);
+  if (time != R_NilValue) {
+    const int ms = nano_integer(time);
+    if (ms == NA_INTEGER || ms < 0)
+      Rf_error("`time` must be a non-negative integer");
+    atomic_store(&later_latency, ms);
+  }
+
+  return Rf_ScalarInteger(prev);
+
+}
+
 // aio completion callbacks ----------------------------------------------------
 
 
@@ -73,6 +172,7 @@ static void sendaio_complete(void *arg) {
   nng_aio *aio = ((nano_saio *) arg)->aio;
   if (nng_aio_result(aio))
     nng_msg_free(nng_aio_get_msg(aio));
+  nano_wait_notify();
 
 }
 
@@ -115,12 +215,16 @@ static void request_complete(void *arg) {
     nng_mtx_lock(mtx);
     raio->result = res;
     ncv->condition++;
+    if (ncv->cq != NULL)
+      nano_cq_push(ncv->cq, &raio->qid);
     nng_cv_wake(cv);
     nng_mtx_unlock(mtx);
   } else {
     raio->result = res;
   }
 
+  nano_wait_notify();
+
   if (saio->cb != NULL)
     later2(raio_invoke_cb, saio->cb);
 
@@ -205,8 +309,14 @@ static void cv_finalizer(SEXP xptr) {
 
   if (NANO_PTR(xptr) == NULL) return;
   nano_cv *xp = (nano_cv *) NANO_PTR(xptr);
+  nano_timer_detach(xptr, xp);
   nng_cv_free(xp->cv);
   nng_mtx_free(xp->mtx);
+  if (xp->cq != NULL) {
+    free(xp->cq->queue);
+    free(xp->cq->slots);
+    free(xp->cq);
+  }
   free(xp);
 
 }
@@ -215,6 +325,11 @@ static void request_finalizer(SEXP xptr) {
 
   if (NANO_PTR(xptr) == NULL) return;
   nano_aio *xp = (nano_aio *) NANO_PTR(xptr);
+  nano_timer_detach(xptr, xp->aio);
+  if (xp->pool) {
+    nano_pool_put(xp);
+    return;
+  }
   nano_saio *saio = (nano_saio *) xp->cb;
   nng_aio_free(saio->aio);
   nng_aio_free(xp->aio);
@@ -459,6 +574,148 @@ SEXP rnng_cv_signal(SEXP cvar) {
 
 }
 
+// completion queues -----------------------------------------------------------
+
+SEXP rnng_cq_alloc(void) {
+
+  SEXP xp;
+  int xc;
+  nano_cv *cvp = calloc(1, sizeof(nano_cv));
+  NANO_ENSURE_ALLOC(cvp);
+  cvp->cq = calloc(1, sizeof(nano_cq));
+  NANO_ENSURE_ALLOC(cvp->cq);
+
+  if ((xc = nng_mtx_alloc(&cvp->mtx)))
+    goto fail;
+
+  if ((xc = nng_cv_alloc(&cvp->cv, cvp->mtx)))
+    goto fail;
+
+  PROTECT(xp = R_MakeExternalPtr(cvp, nano_CvSymbol, R_NilValue));
+  R_RegisterCFinalizerEx(xp, cv_finalizer, TRUE);
+  NANO_CLASS2(xp, "completionQueue", "conditionVariable");
+
+  UNPROTECT(1);
+  return xp;
+
+  fail:
+  nng_mtx_free(cvp->mtx);
+  failmem:
+  if (cvp != NULL)
+    free(cvp->cq);
+  free(cvp);
+  ERROR_OUT(xc);
+
+}
+
+// ensures a free slot, growing the queue and its table of Aios if required
+void nano_cq_ensure(SEXP cqueue) {
+
+  nano_cv *ncv = (nano_cv *) NANO_PTR(cqueue);
+  nano_cq *cq = ncv->cq;
+  if (cq->nfree)
+    return;
+
+  const int size = cq->size ? cq->size * 2 : 16;
+  SEXP table, old = NANO_PROT(cqueue);
+  PROTECT(table = Rf_allocVector(VECSXP, size));
+  for (int i = 0; i < cq->size; i++)
+    SET_VECTOR_ELT(table, i, VECTOR_ELT(old, i));
+
+  int *queue = malloc(size * sizeof(int));
+  int *slots = malloc(size * sizeof(int));
+  if (queue == NULL || slots == NULL) {
+    free(queue);
+    free(slots);
+    ERROR_OUT(2);
+  }
+  for (int i = 0; i < size - cq->size; i++)
+    slots[i] = size - 1 - i;
+
+  nng_mtx_lock(ncv->mtx);
+  for (int i = 0; i < cq->count; i++)
+    queue[i] = cq->queue[(cq->head + i) % cq->size];
+  free(cq->queue);
+  free(cq->slots);
+  cq->queue = queue;
+  cq->slots = slots;
+  cq->head = 0;
+  cq->nfree = size - cq->size;
+  cq->size = size;
+  nng_mtx_unlock(ncv->mtx);
+
+  NANO_SET_PROT(cqueue, table);
+  UNPROTECT(1);
+
+}
+
+// Takes a slot for an Aio submitted with qid NANO_CQ_PENDING, once all R
+// allocations for it are done, so that an allocation error cannot leave a
+// slot taken with no Aio in it. Must follow nano_cq_ensure(), which reserves
+// a free slot without allocating.
+void nano_cq_register(SEXP cqueue, int *qid, SEXP x) {
+
+  nano_cv *ncv = (nano_cv *) NANO_PTR(cqueue);
+  nano_cq *cq = ncv->cq;
+
+  nng_mtx_lock(ncv->mtx);
+  const int done = *qid == NANO_CQ_DONE;
+  *qid = cq->slots[--cq->nfree];
+  if (done)
+    nano_cq_push(cq, qid);
+  nng_mtx_unlock(ncv->mtx);
+
+  SET_VECTOR_ELT(NANO_PROT(cqueue), *qid, x);
+
+}
+
+SEXP rnng_cq_next(SEXP cqueue, SEXP timeout) {
+
+  if (NANO_PTR_CHECK(cqueue, nano_CvSymbol) || ((nano_cv *) NANO_PTR(cqueue))->cq == NULL)
+    Rf_error("`cq` is not a valid Completion Queue");
+
+  nano_cv *ncv = (nano_cv *) NANO_PTR(cqueue);
+  nano_cq *cq = ncv->cq;
+  nng_cv *cv = ncv->cv;
+  nng_mtx *mtx = ncv->mtx;
+
+  const int dur = timeout == R_NilValue ? -1 : nano_integer(timeout);
+  const nng_time time = nng_clock() + (nng_time) dur;
+  int qid = -1;
+
+  nng_mtx_lock(mtx);
+  while (cq->count == 0) {
+    // return immediately if there are no outstanding Aios
+    if (cq->nfree == cq->size || dur == 0)
+      break;
+    if (dur > 0) {
+      if (nng_cv_until(cv, time) == NNG_ETIMEDOUT)
+        break;
+    } else if (nng_cv_until(cv, nng_clock() + 400) == NNG_ETIMEDOUT) {
+      nng_mtx_unlock(mtx);
+      R_CheckUserInterrupt();
+      nng_mtx_lock(mtx);
+    }
+  }
+  if (cq->count) {
+    qid = cq->queue[cq->head];
+    cq->head = (cq->head + 1) % cq->size;
+    cq->count--;
+  }
+  nng_mtx_unlock(mtx);
+
+  if (qid < 0)
+    return R_NilValue;
+
+  SEXP table = NANO_PROT(cqueue);
+  SEXP out = VECTOR_ELT(table, qid);
+  SET_VECTOR_ELT(table, qid, R_NilValue);
+  cq->slots[cq->nfree++] = qid;
+
+  return out;
+
+}
+
 // request ---------------------------------------------------------------------
 
 SEXP rnng_request(SEXP con, SEXP data, SEXP sendmode, SEXP recvmode, SEXP timeout, SEXP cvar, SEXP msgid, SEXP clo) {
@@ -475,6 +732,9 @@ SEXP rnng_request(SEXP con, SEXP data, SEXP sendmode, SEXP recvmode, SEXP timeou
   int xc;
 
   nano_cv *ncv = signal ? (nano_cv *) NANO_PTR(cvar) : NULL;
+  nano_cq *cq = signal ? ncv->cq : NULL;
+  if (cq != NULL)
+    nano_cq_ensure(cvar);
 
   nano_saio *saio = NULL;
   nano_aio *raio = NULL;
@@ -482,17 +742,27 @@ SEXP rnng_request(SEXP con, SEXP data, SEXP sendmode, SEXP recvmode, SEXP timeou
   SEXP aio, env, fun;
   nano_buf buf;
 
-  if (raw) {
+  if (raw == 1) {
     nano_encode(&buf, data);
+  } else if (raw == 2) {
+    nano_encode_typed(&buf, data, NANO_HEADROOM);
   } else {
     nano_serialize(&buf, data, NANO_PROT(con), id, NANO_HEADROOM);
   }
 
-  saio = calloc(1, sizeof(nano_saio));
-  NANO_ENSURE_ALLOC(saio);
-
-  raio = calloc(1, sizeof(nano_aio));
-  NANO_ENSURE_ALLOC(raio);
+  if ((raio = nano_pool_get(NANO_POOL_REQ)) == NULL) {
+    saio = calloc(1, sizeof(nano_saio));
+    NANO_ENSURE_ALLOC(saio);
+    raio = calloc(1, sizeof(nano_aio));
+    NANO_ENSURE_ALLOC(raio);
+    if ((xc = nng_aio_alloc(&saio->aio, sendaio_complete, saio)) ||
+        (xc = nng_aio_alloc(&raio->aio, request_complete, raio)))
+      goto fail;
+    raio->pool = NANO_POOL_REQ;
+    raio->cb = saio;
+  } else {
+    saio = (nano_saio *) raio->cb;
+  }
 
   if (TYPEOF(msgid) == EXTPTRSXP) {
     saio->disp = NANO_PTR(msgid);
@@ -504,25 +774,24 @@ SEXP rnng_request(SEXP con, SEXP data, SEXP sendmode, SEXP recvmode, SEXP timeou
   }
   saio->id = msgid != R_NilValue ? id : mod != 1 ? -id : 0;
 
-  if ((xc = nng_msg_alloc(&msg, 0)) ||
-      (xc = nng_aio_alloc(&saio->aio, sendaio_complete, saio))) {
-    nng_msg_free(msg);
-    goto fail;
+  if ((xc = nng_msg_alloc(&msg, 0))) {
+    nano_pool_put(raio);
+    raio = NULL;
+    saio = NULL;
+    goto failmem;
   }
 
-  nano_msg_set_body(msg, &buf, raw ? 0 : NANO_HEADROOM);
+  nano_msg_set_body(msg, &buf, raw == 1 ? 0 : NANO_HEADROOM);
 
   nng_aio_set_msg(saio->aio, msg);
   nng_ctx_send(*ctx, saio->aio);
 
   raio->type = signal ? REQAIOS : REQAIO;
   raio->mode = mod;
-  raio->cb = saio;
   raio->next = ncv;
 
-  if ((xc = nng_aio_alloc(&raio->aio, request_complete, raio)))
-    goto fail;
-
+  if (cq != NULL)
+    raio->qid = NANO_CQ_PENDING;
   nng_aio_set_timeout(raio->aio, dur);
   nng_ctx_recv(*ctx, raio->aio);
   NANO_FREE(buf);
@@ -539,10 +808,14 @@ SEXP rnng_request(SEXP con, SEXP data, SEXP sendmode, SEXP recvmode, SEXP timeou
   PROTECT(fun = R_mkClosure(R_NilValue, nano_aioFuncMsg, clo));
   R_MakeActiveBinding(nano_DataSymbol, fun, env);
 
+  if (cq != NULL)
+    nano_cq_register(cvar, &raio->qid, env);
+
   UNPROTECT(3);
   return env;
 
   fail:
+  nng_aio_free(raio->aio);
   nng_aio_free(saio->aio);
   failmem:
   free(raio);
@@ -583,6 +856,7 @@ SEXP rnng_set_promise_context(SEXP x, SEXP ctx) {
     break;
   case SENDAIO:
   case IOV_SENDAIO:
+  case BATCH_SENDAIO:
     break;
   }
 
@@ -704,3 +978,713 @@ SEXP rnng_monitor_read(SEXP x) {
   return out;
 
 }
+
+// background receiver ---------------------------------------------------------
+
+static int nano_policy_mode(SEXP policy) {
+
+  if (TYPEOF(policy) == INTSXP)
+    return NANO_INTEGER(policy) == 2;
+
+  const char *pol = CHAR(STRING_ELT(policy, 0));
+  const size_t slen = strlen(pol);
+
+  switch (slen) {
+  case 4:
+    if (!memcmp(pol, "drop", slen)) return 1;
+    break;
+  case 5:
+    if (!memcmp(pol, "block", slen)) return 0;
+    break;
+  }
+
+  Rf_error("`policy` should be one of: block, drop");
+
+}
+
+static inline void receiver_post(nano_rslot *slot) {
+
+  nano_receiver *rcv = slot->rcv;
+  rcv->sock ? nng_recv_aio(rcv->con.sock, slot->aio) :
+              nng_ctx_recv(rcv->con.ctx, slot->aio);
+
+}
+
+static void receiver_complete(void *arg) {
+
+  nano_rslot *slot = (nano_rslot *) arg;
+  nano_receiver *rcv = slot->rcv;
+  const int res = nng_aio_result(slot->aio);
+  int repost = 0;
+
+  nng_mtx_lock(rcv->mtx);
+  rcv->posted--;
+  if (res == 0) {
+    if (rcv->count == rcv->capacity) {
+      nng_msg_free(rcv->ring[rcv->head]);
+      rcv->head = (rcv->head + 1) % rcv->capacity;
+      rcv->count--;
+    }
+    rcv->ring[(rcv->head + rcv->count) % rcv->capacity] = nng_aio_get_msg(slot->aio);
+    rcv->count++;
+  }
+  // under 'block' a receive is only posted if the ring has room for its message
+  if (!rcv->closed && (res == 0 || res == NNG_ETIMEDOUT)) {
+    if (rcv->drop || rcv->count + rcv->posted < rcv->capacity) {
+      rcv->posted++;
+      repost = 1;
+    } else {
+      slot->parked = 1;
+    }
+  }
+  nng_cv_wake(rcv->ready);
+  nng_mtx_unlock(rcv->mtx);
+
+  if (res == 0 && rcv->cv != NULL) {
+    nano_cv *ncv = rcv->cv;
+    nng_mtx_lock(ncv->mtx);
+    ncv->condition++;
+    nng_cv_wake(ncv->cv);
+    nng_mtx_unlock(ncv->mtx);
+  }
+
+  if (repost)
+    receiver_post(slot);
+  nano_wait_notify();
+
+}
+
+static void receiver_finalizer(SEXP xptr) {
+
+  if (NANO_PTR(xptr) == NULL) return;
+  nano_receiver *rcv = (nano_receiver *) NANO_PTR(xptr);
+
+  nng_mtx_lock(rcv->mtx);
+  rcv->closed = 1;
+  nng_mtx_unlock(rcv->mtx);
+  for (int i = 0; i < rcv->n; i++)
+    nng_aio_stop(rcv->slots[i].aio);
+  for (int i = 0; i < rcv->n; i++)
+    nng_aio_free(rcv->slots[i].aio);
+
+  while (rcv->count) {
+    nng_msg_free(rcv->ring[rcv->head]);
+    rcv->head = (rcv->head + 1) % rcv->capacity;
+    rcv->count--;
+  }
+
+  nng_cv_free(rcv->ready);
+  nng_mtx_free(rcv->mtx);
+  free(rcv->ring);
+  free(rcv->slots);
+  free(rcv);
+
+}
+
+int nano_receiver_take(SEXP x, nng_msg **msgs, const int n, const nng_duration dur) {
+
+  nano_receiver *rcv = (nano_receiver *) NANO_PTR(x);
+  const nng_time time = nng_clock() + (nng_time) dur;
+  int count = 0, xc = 0;
+
+  nng_mtx_lock(rcv->mtx);
+  while (rcv->count == 0) {
+    // with an empty ring every slot is either posted or stopped
+    if (rcv->posted == 0) {
+      xc = NNG_ECLOSED;
+      break;
+    }
+    if (dur == 0) {
+      xc = NNG_EAGAIN;
+      break;
+    }
+    if (dur > 0) {
+      if (nng_cv_until(rcv->ready, time) == NNG_ETIMEDOUT) {
+        xc = NNG_ETIMEDOUT;
+        break;
+      }
+    } else if (nng_cv_until(rcv->ready, nng_clock() + 400) == NNG_ETIMEDOUT) {
+      nng_mtx_unlock(rcv->mtx);
+      R_CheckUserInterrupt();
+      nng_mtx_lock(rcv->mtx);
+    }
+  }
+  while (count < n && rcv->count) {
+    msgs[count++] = rcv->ring[rcv->head];
+    rcv->head = (rcv->head + 1) % rcv->capacity;
+    rcv->count--;
+  }
+  for (int i = 0; i < rcv->n; i++) {
+    if (rcv->slots[i].parked && !rcv->closed && rcv->count + rcv->posted < rcv->capacity) {
+      rcv->slots[i].parked = -1;
+      rcv->posted++;
+    }
+  }
+  nng_mtx_unlock(rcv->mtx);
+
+  for (int i = 0; i < rcv->n; i++) {
+    if (rcv->slots[i].parked == -1) {
+      rcv->slots[i].parked = 0;
+      receiver_post(&rcv->slots[i]);
+    }
+  }
+
+  return xc ? -xc : count;
+
+}
+
+SEXP rnng_receiver_create(SEXP con, SEXP n, SEXP capacity, SEXP policy, SEXP cvar) {
+
+  const int sock = !NANO_PTR_CHECK(con, nano_SocketSymbol);
+  if (!sock && NANO_PTR_CHECK(con, nano_ContextSymbol))
+    Rf_error("`con` is not a valid Socket or Context");
+
+  if (cvar != R_NilValue && NANO_PTR_CHECK(cvar, nano_CvSymbol))
+    Rf_error("`cv` is not a valid Condition Variable");
+
+  const int nr = nano_integer(n);
+  if (nr < 1)
+    Rf_error("`n` must be a positive integer");
+  const int cap = nano_integer(capacity);
+  if (cap < nr)
+    Rf_error("`capacity` must be at least `n`");
+  const int drop = nano_policy_mode(policy);
+
+  SEXP xptr;
+  int xc, i = 0;
+
+  nano_receiver *rcv = calloc(1, sizeof(nano_receiver));
+  NANO_ENSURE_ALLOC(rcv);
+  rcv->slots = calloc(nr, sizeof(nano_rslot));
+  NANO_ENSURE_ALLOC(rcv->slots);
+  rcv->ring = calloc(cap, sizeof(nng_msg *));
+  NANO_ENSURE_ALLOC(rcv->ring);
+  rcv->capacity = (size_t) cap;
+  rcv->drop = drop;
+  rcv->sock = sock;
+  rcv->cv = cvar == R_NilValue ? NULL : (nano_cv *) NANO_PTR(cvar);
+  if (sock) {
+    rcv->con.sock = *(nng_socket *) NANO_PTR(con);
+  } else {
+    rcv->con.ctx = *(nng_ctx *) NANO_PTR(con);
+  }
+
+  if ((xc = nng_mtx_alloc(&rcv->mtx)))
+    goto fail;
+
+  if ((xc = nng_cv_alloc(&rcv->ready, rcv->mtx)))
+    goto fail;
+
+  for (; i < nr; i++) {
+    rcv->slots[i].rcv = rcv;
+    if ((xc = nng_aio_alloc(&rcv->slots[i].aio, receiver_complete, &rcv->slots[i])))
+      goto fail;
+  }
+  rcv->n = nr;
+
+  PROTECT(xptr = R_MakeExternalPtr(rcv, nano_ReceiverSymbol, NANO_PROT(con)));
+  R_RegisterCFinalizerEx(xptr, receiver_finalizer, TRUE);
+  NANO_CLASS2(xptr, "nanoReceiver", "nano");
+  Rf_setAttrib(xptr, nano_CvSymbol, cvar);
+  Rf_setAttrib(xptr, Rf_install("capacity"), Rf_ScalarInteger(cap));
+  Rf_setAttrib(xptr, Rf_install("policy"), Rf_mkString(drop ? "drop" : "block"));
+
+  rcv->posted = nr;
+  for (i = 0; i < nr; i++)
+    receiver_post(&rcv->slots[i]);
+
+  UNPROTECT(1);
+  return xptr;
+
+  fail:
+  while (i--)
+    nng_aio_free(rcv->slots[i].aio);
+  nng_cv_free(rcv->ready);
+  nng_mtx_free(rcv->mtx);
+  failmem:
+  if (rcv != NULL) {
+    free(rcv->ring);
+    free(rcv->slots);
+  }
+  free(rcv);
+  ERROR_OUT(xc);
+
+}
+
+SEXP rnng_receiver_close(SEXP x) {
+
+  if (NANO_PTR_CHECK(x, nano_ReceiverSymbol))
+    Rf_error("`con` is not a valid Receiver");
+
+  nano_receiver *rcv = (nano_receiver *) NANO_PTR(x);
+
+  nng_mtx_lock(rcv->mtx);
+  const int closed = rcv->closed;
+  rcv->closed = 1;
+  nng_mtx_unlock(rcv->mtx);
+  if (closed)
+    ERROR_RET(7);
+
+  for (int i = 0; i < rcv->n; i++)
+    nng_aio_stop(rcv->slots[i].aio);
+
+  return nano_success;
+
+}
+
+// timer wheel -----------------------------------------------------------------
+
+// must be entered under the wheel lock, with t->expire >= w->tick
+static void wheel_insert(nano_wheel *w, nano_timer *t) {
+
+  const uint64_t span = (uint64_t) 1 << (NANO_WHEEL_BITS * NANO_WHEEL_LEVELS);
+  uint64_t delta = t->expire - w->tick;
+  if (delta >= span)
+    delta = span - 1;
+  int level = 0;
+  while (delta >= (uint64_t) 1 << (NANO_WHEEL_BITS * (level + 1)))
+    level++;
+  const int idx = ((w->tick + delta) >> (NANO_WHEEL_BITS * level)) & (NANO_WHEEL_SLOTS - 1);
+
+  nano_timer **head = &w->slots[level][idx];
+  t->prev = NULL;
+  t->next = *head;
+  if (*head != NULL)
+    (*head)->prev = t;
+  *head = t;
+  t->armed = 1 + level * NANO_WHEEL_SLOTS + idx;
+
+}
+
+static void wheel_unlink(nano_wheel *w, nano_timer *t) {
+
+  const int pos = t->armed - 1;
+  if (t->prev != NULL) {
+    t->prev->next = t->next;
+  } else {
+    w->slots[pos / NANO_WHEEL_SLOTS][pos % NANO_WHEEL_SLOTS] = t->next;
+  }
+  if (t->next != NULL)
+    t->next->prev = t->prev;
+  t->prev = t->next = NULL;
+  t->armed = 0;
+
+}
+
+// fires a timer, returning 1 if it should be re-armed
+static int wheel_fire(nano_timer *t) {
+
+  switch (t->op) {
+  case NANO_TIMER_SEND:
+  case NANO_TIMER_SEND_CTX: {
+    nng_msg *msgp;
+    int xc;
+    if (nng_msg_dup(&msgp, t->msg))
+      break;
+    if ((xc = t->op == NANO_TIMER_SEND ? nng_sendmsg(t->tgt.sock, msgp, NNG_FLAG_NONBLOCK) :
+                                         nng_ctx_sendmsg(t->tgt.ctx, msgp, NNG_FLAG_NONBLOCK))) {
+      nng_msg_free(msgp);
+      if (xc == NNG_ECLOSED)
+        return 0;
+    }
+    break;
+  }
+  case NANO_TIMER_SIGNAL: {
+    nano_cv *ncv = t->tgt.cv;
+    nng_mtx_lock(ncv->mtx);
+    ncv->condition++;
+    nng_cv_wake(ncv->cv);
+    nng_mtx_unlock(ncv->mtx);
+    break;
+  }
+  case NANO_TIMER_TIMEOUT:
+    nng_aio_abort(t->tgt.aio, NNG_ETIMEDOUT);
+    return 0;
+  }
+
+  return t->interval > 0;
+
+}
+
+// must be entered under the wheel lock: waits out timers being fired unlocked
+static void wheel_settle(nano_wheel *w) {
+
+  while (w->firing)
+    nng_cv_wait(w->idle);
+
+}
+
+static void wheel_cascade(nano_wheel *w, const int level, const int idx) {
+
+  nano_timer *t = w->slots[level][idx];
+  w->slots[level][idx] = NULL;
+  while (t != NULL) {
+    nano_timer *next = t->next;
+    wheel_insert(w, t);
+    t = next;
+  }
+
+}
+
+// runs on the NNG task threads, processing all ticks that have elapsed - due
+// timers are collected under the lock and fired after releasing it, whilst
+// 'firing' holds off cancellation and the detaching of their targets
+static void wheel_tick(void *arg) {
+
+  nano_wheel *w = (nano_wheel *) arg;
+  const int res = nng_aio_result(w->aio);
+  nano_timer *due = NULL;
+
+  nng_mtx_lock(w->mtx);
+  if (res || w->closed) {
+    w->running = 0;
+    nng_mtx_unlock(w->mtx);
+    return;
+  }
+  const uint64_t now = (uint64_t) (nng_clock() - w->start) / (uint64_t) w->res;
+  while (w->tick <= now && w->active) {
+    const int idx = w->tick & (NANO_WHEEL_SLOTS - 1);
+    for (int level = 1, i = idx; !i && level < NANO_WHEEL_LEVELS; level++) {
+      i = (w->tick >> (NANO_WHEEL_BITS * level)) & (NANO_WHEEL_SLOTS - 1);
+      wheel_cascade(w, level, i);
+    }
+    nano_timer *t = w->slots[0][idx];
+    w->slots[0][idx] = NULL;
+    while (t != NULL) {
+      nano_timer *next = t->next;
+      t->prev = NULL;
+      t->armed = 0;
+      if (t->expire > w->tick) {
+        wheel_insert(w, t);
+      } else {
+        t->next = due;
+        due = t;
+      }
+      t = next;
+    }
+    w->tick++;
+  }
+  w->tick = w->tick > now ? w->tick : now + 1;
+  w->firing = due != NULL;
+  nng_mtx_unlock(w->mtx);
+
+  for (nano_timer *t = due; t != NULL; t = t->next)
+    t->armed = wheel_fire(t);
+
+  nng_mtx_lock(w->mtx);
+  while (due != NULL) {
+    nano_timer *t = due;
+    due = t->next;
+    t->next = NULL;
+    if (t->armed && !w->closed) {
+      t->expire += t->interval;
+      if (t->expire < w->tick)
+        t->expire = w->tick;
+      wheel_insert(w, t);
+    } else {
+      t->armed = 0;
+      w->done[w->ndone++] = (int) (t - w->timers);
+      w->active--;
+    }
+  }
+  w->firing = 0;
+  nng_cv_wake(w->idle);
+  if (w->active && !w->closed) {
+    const nng_time next = w->start + (nng_time) w->tick * (nng_time) w->res;
+    const nng_time clock = nng_clock();
+    nng_sleep_aio(next > clock ? (nng_duration) (next - clock) : 0, w->aio);
+  } else {
+    w->running = 0;
+  }
+  nng_mtx_unlock(w->mtx);
+
+}
+
+static void wheel_finalizer(SEXP xptr) {
+
+  if (NANO_PTR(xptr) == NULL) return;
+  nano_wheel *w = (nano_wheel *) NANO_PTR(xptr);
+
+  nng_mtx_lock(w->mtx);
+  w->closed = 1;
+  nng_mtx_unlock(w->mtx);
+  nng_aio_stop(w->aio);
+  // targets finalized later in the same collection find the wheel gone
+  R_ClearExternalPtr(xptr);
+
+  for (int i = 0; i < w->capacity; i++) {
+    if (w->timers[i].msg != NULL)
+      nng_msg_free(w->timers[i].msg);
+  }
+  nng_aio_free(w->aio);
+  nng_cv_free(w->idle);
+  nng_mtx_free(w->mtx);
+  free(w->done);
+  free(w->free);
+  free(w->timers);
+  free(w);
+
+}
+
+// returns the slots of fired timers to the free list, releasing their targets
+static void wheel_reap(SEXP wheel) {
+
+  nano_wheel *w = (nano_wheel *) NANO_PTR(wheel);
+  SEXP table = NANO_PROT(wheel);
+
+  nng_mtx_lock(w->mtx);
+  while (w->ndone) {
+    const int i = w->done[--w->ndone];
+    if (w->timers[i].msg != NULL) {
+      nng_msg_free(w->timers[i].msg);
+      w->timers[i].msg = NULL;
+    }
+    SET_VECTOR_ELT(table, i, R_NilValue);
+    w->free[w->nfree++] = i;
+  }
+  nng_mtx_unlock(w->mtx);
+
+}
+
+// a cv or Aio target references the wheel, so that it remains valid for
+// nano_timer_detach() when the two are collected together
+static void wheel_attach(SEXP target, SEXP wheel) {
+
+  const SEXP list = Rf_getAttrib(target, nano_TimerSymbol);
+  for (SEXP x = list; x != R_NilValue; x = CDR(x)) {
+    if (CAR(x) == wheel)
+      return;
+  }
+  Rf_setAttrib(target, nano_TimerSymbol, Rf_cons(wheel, list));
+
+}
+
+// called from the finalizer of a cv or Aio before its resources are freed,
+// disarming any timers that target it, including one being fired
+void nano_timer_detach(SEXP xptr, void *ptr) {
+
+  for (SEXP x = Rf_getAttrib(xptr, nano_TimerSymbol); x != R_NilValue; x = CDR(x)) {
+    nano_wheel *w = (nano_wheel *) NANO_PTR(CAR(x));
+    if (w == NULL) continue;
+    nng_mtx_lock(w->mtx);
+    wheel_settle(w);
+    for (int i = 0; i < w->capacity; i++) {
+      nano_timer *t = &w->timers[i];
+      if (t->armed && (t->op == NANO_TIMER_SIGNAL ? (void *) t->tgt.cv :
+                       t->op == NANO_TIMER_TIMEOUT ? (void *) t->tgt.aio : NULL) == ptr) {
+        wheel_unlink(w, t);
+        w->active--;
+        w->done[w->ndone++] = i;
+      }
+    }
+    nng_mtx_unlock(w->mtx);
+  }
+
+}
+
+static SEXP wheel_schedule(SEXP wheel, nano_timer_op op, SEXP target, void *ptr, nng_msg *msg, SEXP delay, SEXP interval) {
+
+  nano_wheel *w = (nano_wheel *) NANO_PTR(wheel);
+  const int dur = nano_integer(delay);
+  const int ivl = interval == R_NilValue ? 0 : nano_integer(interval);
+  if (dur < 0 || ivl < 0) {
+    if (msg != NULL) nng_msg_free(msg);
+    Rf_error("`delay` and `interval` must be non-negative");
+  }
+
+  wheel_reap(wheel);
+  if (w->nfree == 0) {
+    if (msg != NULL) nng_msg_free(msg);
+    ERROR_RET(NNG_ENOSPC);
+  }
+
+  const int i = w->free[--w->nfree];
+  nano_timer *t = &w->timers[i];
+  t->id = t->id > INT_MAX - w->capacity ? i + 1 : t->id + w->capacity;
+  t->op = op;
+  t->msg = msg;
+  t->interval = ((uint64_t) ivl + w->res - 1) / w->res;
+  switch (op) {
+  case NANO_TIMER_SEND:
+    t->tgt.sock = *(nng_socket *) ptr;
+    break;
+  case NANO_TIMER_SEND_CTX:
+    t->tgt.ctx = *(nng_ctx *) ptr;
+    break;
+  case NANO_TIMER_SIGNAL:
+    t->tgt.cv = (nano_cv *) ptr;
+    wheel_attach(target, wheel);
+    break;
+  case NANO_TIMER_TIMEOUT:
+    t->tgt.aio = (nng_aio *) ptr;
+    wheel_attach(target, wheel);
+    break;
+  }
+  SET_VECTOR_ELT(NANO_PROT(wheel), i, target);
+
+  nng_mtx_lock(w->mtx);
+  const nng_time now = nng_clock() - w->start;
+  if (!w->running)
+    w->tick = (uint64_t) now / w->res;
+  t->expire = ((uint64_t) now + dur + w->res - 1) / w->res;
+  if (t->expire < w->tick)
+    t->expire = w->tick;
+  wheel_insert(w, t);
+  w->active++;
+  if (!w->running && !w->closed) {
+    w->running = 1;
+    const nng_duration wait = (nng_duration) (t->expire * w->res - now);
+    nng_sleep_aio(wait > 0 ? wait : 0, w->aio);
+  }
+  nng_mtx_unlock(w->mtx);
+
+  return Rf_ScalarInteger(t->id);
+
+}
+
+SEXP rnng_timer_wheel(SEXP resolution, SEXP capacity) {
+
+  const int res = nano_integer(resolution);
+  if (res < 1)
+    Rf_error("`resolution` must be a positive integer");
+  const int cap = nano_integer(capacity);
+  if (cap < 1)
+    Rf_error("`capacity` must be a positive integer");
+
+  SEXP xptr;
+  int xc;
+
+  nano_wheel *w = calloc(1, sizeof(nano_wheel));
+  NANO_ENSURE_ALLOC(w);
+  w->timers = calloc(cap, sizeof(nano_timer));
+  NANO_ENSURE_ALLOC(w->timers);
+  w->free = malloc(cap * sizeof(int));
+  NANO_ENSURE_ALLOC(w->free);
+  w->done = malloc(cap * sizeof(int));
+  NANO_ENSURE_ALLOC(w->done);
+  for (int i = 0; i < cap; i++) {
+    w->timers[i].id = i + 1 - cap;
+    w->free[i] = cap - 1 - i;
+  }
+  w->capacity = cap;
+  w->nfree = cap;
+  w->res = (nng_duration) res;
+  w->start = nng_clock();
+
+  if ((xc = nng_mtx_alloc(&w->mtx)) ||
+      (xc = nng_cv_alloc(&w->idle, w->mtx)))
+    goto fail;
+
+  if ((xc = nng_aio_alloc(&w->aio, wheel_tick, w)))
+    goto fail;
+
+  PROTECT(xptr = R_MakeExternalPtr(w, nano_TimerSymbol, Rf_allocVector(VECSXP, cap)));
+  R_RegisterCFinalizerEx(xptr, wheel_finalizer, TRUE);
+  NANO_CLASS2(xptr, "nanoTimer", "nano");
+  Rf_setAttrib(xptr, Rf_install("resolution"), Rf_ScalarInteger(res));
+  Rf_setAttrib(xptr, Rf_install("capacity"), Rf_ScalarInteger(cap));
+
+  UNPROTECT(1);
+  return xptr;
+
+  fail:
+  nng_cv_free(w->idle);
+  nng_mtx_free(w->mtx);
+  failmem:
+  if (w != NULL) {
+    free(w->done);
+    free(w->free);
+    free(w->timers);
+  }
+  free(w);
+  ERROR_OUT(xc);
+
+}
+
+SEXP rnng_timer_send(SEXP wheel, SEXP con, SEXP data, SEXP mode, SEXP delay, SEXP interval) {
+
+  if (NANO_PTR_CHECK(wheel, nano_TimerSymbol))
+    Rf_error("`wheel` is not a valid Timer Wheel");
+
+  const int sock = !NANO_PTR_CHECK(con, nano_SocketSymbol);
+  if (!sock && NANO_PTR_CHECK(con, nano_ContextSymbol))
+    Rf_error("`con` is not a valid Socket or Context");
+
+  const int raw = nano_encode_mode(mode);
+  nano_buf buf;
+  nng_msg *msgp = NULL;
+  int xc;
+
+  if (raw == 1) {
+    nano_encode(&buf, data);
+  } else if (raw == 2) {
+    nano_encode_typed(&buf, data, NANO_HEADROOM);
+  } else {
+    nano_serialize(&buf, data, NANO_PROT(con), 0, NANO_HEADROOM);
+  }
+
+  if ((xc = nng_msg_alloc(&msgp, 0))) {
+    NANO_FREE(buf);
+    ERROR_OUT(xc);
+  }
+  nano_msg_set_body(msgp, &buf, raw == 1 ? 0 : NANO_HEADROOM);
+  NANO_FREE(buf);
+
+  return wheel_schedule(wheel, sock ? NANO_TIMER_SEND : NANO_TIMER_SEND_CTX, con, NANO_PTR(con), msgp, delay, interval);
+
+}
+
+SEXP rnng_timer_signal(SEXP wheel, SEXP cvar, SEXP delay, SEXP interval) {
+
+  if (NANO_PTR_CHECK(wheel, nano_TimerSymbol))
+    Rf_error("`wheel` is not a valid Timer Wheel");
+
+  if (NANO_PTR_CHECK(cvar, nano_CvSymbol))
+    Rf_error("`cv` is not a valid Condition Variable");
+
+  return wheel_schedule(wheel, NANO_TIMER_SIGNAL, cvar, NANO_PTR(cvar), NULL, delay, interval);
+
+}
+
+SEXP rnng_timer_timeout(SEXP wheel, SEXP x, SEXP delay) {
+
+  if (NANO_PTR_CHECK(wheel, nano_TimerSymbol))
+    Rf_error("`wheel` is not a valid Timer Wheel");
+
+  const SEXP coreaio = TYPEOF(x) == ENVSXP ? nano_findVarInFrame(x, nano_AioSymbol, NULL) : x;
+  if (NANO_PTR_CHECK(coreaio, nano_AioSymbol))
+    Rf_error("`aio` is not a valid Aio");
+
+  nano_aio *aiop = (nano_aio *) NANO_PTR(coreaio);
+
+  return wheel_schedule(wheel, NANO_TIMER_TIMEOUT, coreaio, aiop->aio, NULL, delay, R_NilValue);
+
+}
+
+SEXP rnng_timer_cancel(SEXP wheel, SEXP id) {
+
+  if (NANO_PTR_CHECK(wheel, nano_TimerSymbol))
+    Rf_error("`wheel` is not a valid Timer Wheel");
+
+  nano_wheel *w = (nano_wheel *) NANO_PTR(wheel);
+  const int tid = nano_integer(id);
+  int cancelled = 0;
+
+  if (tid > 0) {
+    const int i = (tid - 1) % w->capacity;
+    nano_timer *t = &w->timers[i];
+    nng_mtx_lock(w->mtx);
+    wheel_settle(w);
+    if (t->id == tid && t->armed) {
+      wheel_unlink(w, t);
+      w->active--;
+      w->done[w->ndone++] = i;
+      cancelled = 1;
+    }
+    nng_mtx_unlock(w->mtx);
+  }
+  wheel_reap(wheel);
+
+  return Rf_ScalarLogical(cancelled);
+
+}
@@ -3,137 +3,81 @@
 #define NANONEXT_PROTOCOLS
 #define NANONEXT_IO
 #include "nanonext.h"
+#include <stdatomic.h>
 
 // threads --------------------------------------------------------------------
 
+// Waiting on Aios is multiplexed through their completion callbacks: each
+// callback calls nano_wait_notify(), which wakes the one shared cv whenever
+// the R thread is waiting. No threads are created however many Aios are
+// waited on, and waits remain user-interruptible.
+
 static nng_mtx *nano_wait_mtx = NULL;
 static nng_cv *nano_wait_cv = NULL;
-static nng_thread *nano_wait_thr = NULL;
-static nng_aio *nano_shared_aio = NULL;
-static int nano_wait_condition = 0;
+static atomic_int nano_waiting = 0;
+static atomic_int nano_wait_closed = 0;
+static atomic_int nano_wait_notifying = 0;
 
+// Callbacks may still be running when this is called, ahead of nng_fini(), so
+// new notifications are refused and those in progress drained before the free.
 void nano_thread_shutdown(void) {
-  if (nano_wait_thr == NULL)
+  atomic_store(&nano_wait_closed, 1);
+  atomic_store(&nano_waiting, 0);
+  while (atomic_load(&nano_wait_notifying))
+    nng_msleep(1);
+  if (nano_wait_mtx == NULL)
     return;
-  if (nano_shared_aio != NULL)
-    nng_aio_stop(nano_shared_aio);
-  nng_mtx_lock(nano_wait_mtx);
-  nano_wait_condition = -1;
-  nng_cv_wake(nano_wait_cv);
-  nng_mtx_unlock(nano_wait_mtx);
-  nng_thread_destroy(nano_wait_thr);
   nng_cv_free(nano_wait_cv);
   nng_mtx_free(nano_wait_mtx);
-  nano_wait_thr = NULL;
-}
-
-static void thread_finalizer(SEXP xptr) {
-
-  if (NANO_PTR(xptr) == NULL) return;
-  nng_thread *xp = (nng_thread *) NANO_PTR(xptr);
-  nng_thread_destroy(xp);
-
-}
-
-// # nocov start
-// tested interactively
-
-static void thread_aio_finalizer(SEXP xptr) {
-
-  if (NANO_PTR(xptr) == NULL) return;
-  nano_thread_aio *xp = (nano_thread_aio *) NANO_PTR(xptr);
-  nano_cv *ncv = xp->cv;
-  nng_mtx *mtx = ncv->mtx;
-  nng_cv *cv = ncv->cv;
-  nng_aio_stop(xp->aio);
-  nng_thread_destroy(xp->thr);
-  nng_cv_free(cv);
-  nng_mtx_free(mtx);
-  free(ncv);
-  free(xp);
-
+  nano_wait_cv = NULL;
+  nano_wait_mtx = NULL;
 }
 
-
-static void rnng_wait_thread_single(void *args) {
-
-  nano_thread_aio *taio = (nano_thread_aio *) args;
-  nano_cv *ncv = taio->cv;
-  nng_mtx *mtx = ncv->mtx;
-  nng_cv *cv = ncv->cv;
-
-  nng_aio_wait(taio->aio);
-
-  nng_mtx_lock(mtx);
-  ncv->condition = 1;
-  nng_cv_wake(cv);
-  nng_mtx_unlock(mtx);
-
+void nano_wait_notify(void) {
+  atomic_fetch_add(&nano_wait_notifying, 1);
+  // pairs with the fence in nano_wait_aio(), so that either the waiter sees
+  // the result just set, or this sees the waiter and wakes it
+  atomic_thread_fence(memory_order_seq_cst);
+  if (!atomic_load(&nano_wait_closed) && atomic_load_explicit(&nano_waiting, memory_order_relaxed)) {
+    nng_mtx_lock(nano_wait_mtx);
+    nng_cv_wake(nano_wait_cv);
+    nng_mtx_unlock(nano_wait_mtx);
+  }
+  atomic_fetch_sub(&nano_wait_notifying, 1);
 }
 
-static void single_wait_thread_create(SEXP x) {
-
-  nano_aio *aiop = (nano_aio *) NANO_PTR(x);
-
-  int xc, signalled;
-  nano_thread_aio *taio = NULL;
-  nano_cv *ncv = NULL;
-
-  taio = malloc(sizeof(nano_thread_aio));
-  NANO_ENSURE_ALLOC(taio);
-  ncv = calloc(1, sizeof(nano_cv));
-  NANO_ENSURE_ALLOC(ncv);
-  taio->aio = aiop->aio;
-  taio->cv = ncv;
-  nng_mtx *mtx = NULL;
-  nng_cv *cv = NULL;
-
-  if ((xc = nng_mtx_alloc(&mtx)) ||
-      (xc = nng_cv_alloc(&cv, mtx)))
-    goto fail;
-
-  ncv->mtx = mtx;
-  ncv->cv = cv;
+static void nano_wait_aio(nano_aio *aiop) {
 
-  if ((xc = nng_thread_create(&taio->thr, rnng_wait_thread_single, taio)))
-    goto fail;
-
-  SEXP xptr;
-  PROTECT(xptr = R_MakeExternalPtr(taio, R_NilValue, R_NilValue));
-  R_RegisterCFinalizerEx(xptr, thread_aio_finalizer, TRUE);
-  R_MakeWeakRef(x, xptr, R_NilValue, TRUE);
-  UNPROTECT(1);
-
-  nng_time time = nng_clock();
+  int signalled;
+  atomic_store(&nano_waiting, 1);
+  atomic_thread_fence(memory_order_seq_cst);
 
   while (1) {
-    time = time + 400;
+    const nng_time time = nng_clock() + 400;
     signalled = 1;
-    nng_mtx_lock(mtx);
-    while (ncv->condition == 0) {
-      if (nng_cv_until(cv, time) == NNG_ETIMEDOUT) {
+    nng_mtx_lock(nano_wait_mtx);
+    while (aiop->result == 0 && nng_aio_busy(aiop->aio)) {
+      if (nng_cv_until(nano_wait_cv, time) == NNG_ETIMEDOUT) {
         signalled = 0;
         break;
       }
     }
-    nng_mtx_unlock(mtx);
+    nng_mtx_unlock(nano_wait_mtx);
     if (signalled) break;
     R_CheckUserInterrupt();
   }
 
-  return;
-
-  fail:
-  nng_cv_free(cv);
-  nng_mtx_free(mtx);
-  failmem:
-  free(ncv);
-  free(taio);
-  ERROR_OUT(xc);
+  atomic_store(&nano_waiting, 0);
 
 }
 
-// # nocov end
+static void thread_finalizer(SEXP xptr) {
+
+  if (NANO_PTR(xptr) == NULL) return;
+  nng_thread *xp = (nng_thread *) NANO_PTR(xptr);
+  nng_thread_destroy(xp);
+
+}
 
 static void thread_duo_finalizer(SEXP xptr) {
 
@@ -153,85 +97,31 @@ static void thread_duo_finalizer(SEXP xptr) {
 
 }
 
-static void rnng_wait_thread(void *args) {
-
-  while (1) {
-    nng_mtx_lock(nano_wait_mtx);
-    while (nano_wait_condition == 0)
-      nng_cv_wait(nano_wait_cv);
-    if (nano_wait_condition == -1) {
-      nng_mtx_unlock(nano_wait_mtx);
-      break;
-    }
-    nng_mtx_unlock(nano_wait_mtx);
-
-    nng_aio_wait(nano_shared_aio);
-
-    nng_mtx_lock(nano_wait_mtx);
-    nano_shared_aio = NULL;
-    nano_wait_condition = 0;
-    nng_cv_wake(nano_wait_cv);
-    nng_mtx_unlock(nano_wait_mtx);
-  }
-
-}
-
 SEXP rnng_wait_thread_create(SEXP x) {
 
   const SEXPTYPE typ = TYPEOF(x);
-  if (typ == ENVSXP) {
+  if (typ == ENVSXP || typ == EXTPTRSXP) {
 
-    const SEXP coreaio = nano_findVarInFrame(x, nano_AioSymbol, NULL);
+    const SEXP coreaio = typ == ENVSXP ? nano_findVarInFrame(x, nano_AioSymbol, NULL) : x;
     if (NANO_PTR_CHECK(coreaio, nano_AioSymbol))
       return x;
 
     nano_aio *aiop = (nano_aio *) NANO_PTR(coreaio);
 
-    int xc, signalled;
+    int xc;
 
-    if (nano_wait_thr == NULL) {
+    if (nano_wait_mtx == NULL) {
       if ((xc = nng_mtx_alloc(&nano_wait_mtx)) ||
-          (xc = nng_cv_alloc(&nano_wait_cv, nano_wait_mtx)) ||
-          (xc = nng_thread_create(&nano_wait_thr, rnng_wait_thread, NULL)))
+          (xc = nng_cv_alloc(&nano_wait_cv, nano_wait_mtx)))
         goto fail;
+      atomic_store(&nano_wait_closed, 0);
     }
 
-    int thread_required = 0;
-    nng_mtx_lock(nano_wait_mtx);
-    if (nano_wait_condition == 0) {
-      nano_shared_aio = aiop->aio;
-      nano_wait_condition = 1;
-      nng_cv_wake(nano_wait_cv);
-    } else {
-      thread_required = nano_shared_aio != aiop->aio;
-    }
-    nng_mtx_unlock(nano_wait_mtx);
-
-    if (thread_required) {
-
-      PROTECT(coreaio);
-      single_wait_thread_create(coreaio);
-      UNPROTECT(1);
-
-    } else {
-
-      nng_time time = nng_clock();
-
-      while (1) {
-        time = time + 400;
-        signalled = 1;
-        nng_mtx_lock(nano_wait_mtx);
-        while (nano_wait_condition == 1) {
-          if (nng_cv_until(nano_wait_cv, time) == NNG_ETIMEDOUT) {
-            signalled = 0;
-            break;
-          }
-        }
-        nng_mtx_unlock(nano_wait_mtx);
-        if (signalled) break;
-        R_CheckUserInterrupt();
-      }
+    nano_wait_aio(aiop);
 
+    if (typ == EXTPTRSXP) {
+      nano_aio_lite_value(x);
+      return x;
     }
 
     switch (aiop->type) {
@@ -245,6 +135,7 @@ SEXP rnng_wait_thread_create(SEXP x) {
       break;
     case SENDAIO:
     case IOV_SENDAIO:
+    case BATCH_SENDAIO:
       nano_aio_result(x);
       break;
     case HTTP_AIO:
@@ -257,6 +148,8 @@ SEXP rnng_wait_thread_create(SEXP x) {
     fail:
     nng_cv_free(nano_wait_cv);
     nng_mtx_free(nano_wait_mtx);
+    nano_wait_cv = NULL;
+    nano_wait_mtx = NULL;
     ERROR_OUT(xc);
 
   } else if (typ == VECSXP) {
@@ -433,7 +326,7 @@ SEXP rnng_read_stdin(SEXP interactive) {
   int xc;
   nng_socket *sock = NULL;
   nng_listener *lp = NULL;
-  sock = malloc(sizeof(nng_socket));
+  sock = calloc(1, sizeof(nano_sockctx));
   NANO_ENSURE_ALLOC(sock);
   lp = malloc(sizeof(nng_listener));
   NANO_ENSURE_ALLOC(lp);
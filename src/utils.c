@@ -39,6 +39,149 @@ SEXP rnng_sleep(SEXP msec) {
 
 }
 
+static int nano_thread_count(SEXP x, const char *arg) {
+
+  if (x == R_NilValue)
+    return 0;
+  const int n = nano_integer(x);
+  if (n < 1)
+    Rf_error("`%s` must be a positive integer", arg);
+  return n;
+
+}
+
+static void nano_thread_cpus(SEXP x) {
+
+  switch (TYPEOF(x)) {
+  case NILSXP:
+    return;
+  case INTSXP: {
+    const int *cpus = INTEGER(x);
+    for (R_xlen_t i = 0; i < XLENGTH(x); i++) {
+      if (cpus[i] == NA_INTEGER || cpus[i] < 0)
+        Rf_error("`affinity` CPU indices must be non-negative integers");
+    }
+    return;
+  }
+  case REALSXP: {
+    const double *cpus = REAL(x);
+    for (R_xlen_t i = 0; i < XLENGTH(x); i++) {
+      if (ISNAN(cpus[i]) || cpus[i] < 0 || cpus[i] >= INT_MAX)
+        Rf_error("`affinity` CPU indices must be non-negative integers");
+    }
+    return;
+  }
+  default:
+    Rf_error("`affinity` must be an integer vector of CPU indices or a named list of them");
+  }
+
+}
+
+SEXP rnng_threads(SEXP task, SEXP expire, SEXP poller, SEXP affinity) {
+
+#ifdef NANONEXT_BUNDLED
+  if (nng_init_done())
+    return Rf_ScalarLogical(0);
+#endif
+
+  // validate every argument before applying any of them
+  const int ntask = nano_thread_count(task, "task");
+  const int nexpire = nano_thread_count(expire, "expire");
+  const int npoller = nano_thread_count(poller, "poller");
+
+  const char *names[] = {"task", "expire", "poller"};
+  SEXP sets[3] = {affinity, affinity, affinity};
+  if (TYPEOF(affinity) == VECSXP) {
+    SEXP nms = Rf_getAttrib(affinity, R_NamesSymbol);
+    if (nms == R_NilValue)
+      Rf_error("`affinity` must be an integer vector of CPU indices or a named list of them");
+    sets[0] = sets[1] = sets[2] = R_NilValue;
+    for (R_xlen_t i = 0; i < XLENGTH(affinity); i++) {
+      int j = 0;
+      while (j < 3 && strcmp(CHAR(STRING_ELT(nms, i)), names[j])) j++;
+      if (j == 3)
+        Rf_error("`affinity` list names must be 'task', 'expire' or 'poller'");
+      sets[j] = VECTOR_ELT(affinity, i);
+    }
+  }
+  for (int i = 0; i < 3; i++)
+    nano_thread_cpus(sets[i]);
+#ifndef NANONEXT_BUNDLED
+  if (affinity != R_NilValue)
+    Rf_error("`affinity` is not supported with a system 'libnng'");
+#endif
+
+  // an explicit count also lifts the default cap
+  if (ntask) {
+    nng_init_set_parameter(NNG_INIT_NUM_TASK_THREADS, (uint64_t) ntask);
+    nng_init_set_parameter(NNG_INIT_MAX_TASK_THREADS, (uint64_t) ntask);
+  }
+  if (nexpire) {
+    nng_init_set_parameter(NNG_INIT_NUM_EXPIRE_THREADS, (uint64_t) nexpire);
+    nng_init_set_parameter(NNG_INIT_MAX_EXPIRE_THREADS, (uint64_t) nexpire);
+  }
+  if (npoller) {
+    nng_init_set_parameter(NNG_INIT_NUM_POLLER_THREADS, (uint64_t) npoller);
+    nng_init_set_parameter(NNG_INIT_MAX_POLLER_THREADS, (uint64_t) npoller);
+  }
+
+#ifdef NANONEXT_BUNDLED
+  const nng_init_parameter pools[] = {NNG_INIT_NUM_TASK_THREADS, NNG_INIT_NUM_EXPIRE_THREADS, NNG_INIT_NUM_POLLER_THREADS};
+  int xc = 0;
+  for (int i = 0; i < 3 && !xc; i++) {
+    if (sets[i] == R_NilValue)
+      continue;
+    SEXP set = PROTECT(Rf_coerceVector(sets[i], INTSXP));
+    xc = nng_init_set_affinity(pools[i], INTEGER(set), (size_t) XLENGTH(set));
+    UNPROTECT(1);
+  }
+  if (xc)
+    ERROR_OUT(xc);
+
+  return Rf_ScalarLogical(1);
+#else
+  // a system 'libnng' does not report whether it has already initialized
+  return Rf_ScalarLogical(NA_LOGICAL);
+#endif
+
+}
+
+SEXP rnng_thread_info(void) {
+
+  const char *names[] = {"task", "expire", "poller", "resolver", "affinity", ""};
+  const char *pnames[] = {"task", "expire", "poller", ""};
+
+  SEXP out, affinity;
+  PROTECT(out = Rf_mkNamed(VECSXP, names));
+  affinity = Rf_mkNamed(VECSXP, pnames);
+  SET_VECTOR_ELT(out, 4, affinity);
+#ifdef NANONEXT_BUNDLED
+  const nng_init_parameter pools[] = {NNG_INIT_NUM_TASK_THREADS, NNG_INIT_NUM_EXPIRE_THREADS, NNG_INIT_NUM_POLLER_THREADS, NNG_INIT_NUM_RESOLVER_THREADS};
+  const int done = nng_init_done();
+  for (int i = 0; i < 4; i++) {
+    const uint64_t n = done ? nng_init_get_effective(pools[i]) : (uint64_t) -1;
+    SET_VECTOR_ELT(out, i, Rf_ScalarInteger(n == (uint64_t) -1 ? NA_INTEGER : (int) n));
+  }
+  for (int i = 0; i < 3; i++) {
+    const int *set;
+    size_t n;
+    if (nng_init_get_affinity(pools[i], &set, &n)) {
+      SEXP cpus = Rf_allocVector(INTSXP, (R_xlen_t) n);
+      memcpy(INTEGER(cpus), set, n * sizeof(int));
+      SET_VECTOR_ELT(affinity, i, cpus);
+    }
+  }
+#else
+  // a system 'libnng' reports neither effective counts nor affinity
+  for (int i = 0; i < 4; i++)
+    SET_VECTOR_ELT(out, i, Rf_ScalarInteger(NA_INTEGER));
+#endif
+
+  UNPROTECT(1);
+  return out;
+
+}
+
 SEXP rnng_url_parse(SEXP url) {
 
   const char *up = CHAR(STRING_ELT(url, 0));
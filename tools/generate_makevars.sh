@@ -79,7 +79,8 @@ MBED="$TOOLS/mbedtls.list"
 # The bundled NNG and Mbed TLS sources are compiled directly into nanonext.so
 # (no cmake, no static archive, no install step). configure substitutes:
 #   @cppflags@         package include flags (bundled: -Inng/include
-#                      -Imbedtls/include -DNNG_STATIC_LIB; system: detected -I)
+#                      -Imbedtls/include -DNNG_STATIC_LIB -DNANONEXT_BUNDLED;
+#                      system: detected -I)
 #   @nng_defs@         mbedtls include + the full NNG -D set (probe-derived)
 #   @nng_objects@      bundled NNG objects (empty when a system libnng is used)
 #   @mbedtls_objects@  bundled Mbed TLS objects (empty for a system libmbedtls)
@@ -138,7 +139,7 @@ write_windows_makevars() {
     printf '# nanonext.dll (no cmake, no static archive). Fully static: Windows needs no\n'
     printf '# feature probing. Biarch is served by R'"'"'s native per-sub-arch build.\n'
     printf '#\n# PKG_CFLAGS carries $(C_VISIBILITY) to hide the bundled nng_*/mbedtls_* symbols.\n'
-    printf 'PKG_CPPFLAGS = -Inng/include -Imbedtls/include -DNNG_STATIC_LIB\n'
+    printf 'PKG_CPPFLAGS = -Inng/include -Imbedtls/include -DNNG_STATIC_LIB -DNANONEXT_BUNDLED\n'
     printf 'PKG_CFLAGS = $(C_VISIBILITY)\n'
     printf 'PKG_LIBS = %s\n\n' "$WIN_LIBS"
     printf 'MBED = mbedtls/library\n'